@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <set>
+#include <thread>
+
+#include "common/Tools.hpp"
+#include "renderer/Font.hpp"
+#include "renderer/TextStyle.hpp"
+
+/*
+    dinky_bake <output.cpp> <font file> <name it's loaded as> <body size>...
+
+    Rasterizes printable ASCII and Latin-1 of a font through the same
+    FontRender code the renderer runs, at the size and weight of every
+    TextStyle for each body size given, and writes them out with their
+    kerning pairs as constexpr tables, with FontRender::findBaked over them.
+    Tables are found by the font file's content hash, whatever path the
+    renderer loads it from, the name only labels the output.
+    The tool itself is built without baked fonts (DNK_NO_BAKED_FONTS), since
+    it is what generates them
+*/
+
+static void writeBytes(FILE *out, const std::vector<uint8> &bytes){
+    for(size_t i = 0; i < bytes.size(); ++i){
+        fprintf(out, "%u,%s", bytes[i], i % 32 == 31 ? "\n" : "");
+    }
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 5){
+        fprintf(stderr, "usage: dinky_bake <output.cpp> <font file> <name it's loaded as> <body size>...\n");
+        return 1;
+    }
+    std::string output = argv[1];
+    std::string filename = argv[2];
+    std::string loadedAs = argv[3];
+
+    // styles sharing a size and weight share the font, as they do in the renderer
+    std::set<std::pair<unsigned, unsigned>> fonts;
+    for(int i = 4; i < argc; ++i){
+        auto body = std::atoi(argv[i]);
+        if(body <= 0){
+            fprintf(stderr, "dinky_bake: '%s' isn't a font size\n", argv[i]);
+            return 1;
+        }
+        for(unsigned style = 0; style < TextStyle::COUNT; ++style){
+            fonts.insert(std::make_pair(TextStyle::size(body, style), TextStyle::WEIGHTS[style]));
+        }
+    }
+
+    auto tmp = output + ".part";
+    auto out = fopen(tmp.c_str(), "wb");
+    if(out == NULL){
+        fprintf(stderr, "dinky_bake: Failed to create '%s'\n", tmp.c_str());
+        return 1;
+    }
+    fprintf(out, "// Generated by dinky_bake from %s, don't edit\n\n", loadedAs.c_str());
+    fprintf(out, "#include \"renderer/Font.hpp\"\n\nnamespace {\n\n");
+
+    std::vector<std::string> baked;
+    for(auto &f : fonts){
+        auto size = f.first;
+        auto weight = f.second;
+        auto id = std::to_string(size) + "_" + std::to_string(weight);
+        auto name = "bake" + id;
+        if(!FontRender::load(name, filename, size, "", FontRender::GlyphMode::COVERAGE, weight)){
+            fprintf(stderr, "dinky_bake: Failed to bake '%s' at %upx\n", filename.c_str(), size);
+            fclose(out);
+            remove(tmp.c_str());
+            return 1;
+        }
+        auto &font = *FontRender::find(name);
+        std::vector<unsigned> common;
+        for(unsigned cp = 0; cp < 256; ++cp){
+            if(FontRender::isCommon(cp)){
+                common.push_back(cp);
+            }
+        }
+        // the common range's kerning was built when the font loaded
+        FontRender::preload(font, common, std::max(1u, std::thread::hardware_concurrency()));
+        FontRender::Packed packed;
+        FontRender::pack(font, packed);
+        auto &records = packed.records;
+
+        fprintf(out, "constexpr uint8 PIXELS_%s[] = {\n", id.c_str());
+        writeBytes(out, packed.pixels);
+        fprintf(out, "0 };\n\n");
+        fprintf(out, "constexpr FontRender::GlyphRecord GLYPHS_%s[] = {\n", id.c_str());
+        for(auto &r : records){
+            fprintf(out, "    { %u, %u, %u, %u, %u, %u, %d, %d, %d, %af, %af, 0 },\n",
+                r.codepoint, r.index, r.x, r.y, r.w, r.h, r.origX, r.origY, r.horBearingY, r.sizeX, r.sizeY);
+        }
+        fprintf(out, "};\n\n");
+        // never empty, a zero-length array isn't valid C++
+        fprintf(out, "constexpr FontRender::KernPair KERNING_%s[] = {\n", id.c_str());
+        size_t kernCount = 0;
+        for(auto &k : packed.kerning){
+            if(k.x != 0){
+                fprintf(out, "    { %u, %d },\n", k.pair, k.x);
+                ++kernCount;
+            }
+        }
+        fprintf(out, "    { 0, 0 }\n};\n\n");
+        baked.push_back(id);
+        printf("dinky_bake: %s %upx%s, %zu glyphs, %ux%u atlas\n", loadedAs.c_str(), size, weight == FontRender::FontWeight::BOLD ? " bold" : "", records.size(), packed.width, packed.height);
+
+        // metrics go in the font table below
+        fprintf(out, "constexpr FontRender::BakedFont FONT_%s = { 0x%016llxULL, %u, %u, %u, %d, %u, %d, %d, %u, %u, GLYPHS_%s, %zu, PIXELS_%s, KERNING_%s, %zu, %s };\n\n",
+            id.c_str(), static_cast<unsigned long long>(font.hash), size, font.mode, weight, font.vertAdvance, font.advanceX, font.horiBearingY, font.avgBearingY,
+            packed.width, packed.height,
+            id.c_str(), records.size(), id.c_str(), id.c_str(), kernCount, font.kerns ? "true" : "false");
+    }
+
+    fprintf(out, "constexpr const FontRender::BakedFont *FONTS[] = {\n");
+    for(auto &id : baked){
+        fprintf(out, "    &FONT_%s,\n", id.c_str());
+    }
+    fprintf(out, "};\n\n}\n\n");
+    fprintf(out, "const FontRender::BakedFont *FontRender::findBaked(uint64 hash, unsigned size, unsigned mode, unsigned weight){\n");
+    fprintf(out, "    for(auto font : FONTS){\n");
+    fprintf(out, "        if(font->size == size && font->mode == mode && font->weight == weight && font->hash == hash){\n");
+    fprintf(out, "            return font;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return NULL;\n");
+    fprintf(out, "}\n");
+
+    if(fclose(out) != 0 || rename(tmp.c_str(), output.c_str()) != 0){
+        fprintf(stderr, "dinky_bake: Failed to write '%s'\n", output.c_str());
+        remove(tmp.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,667 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "common/Blit.hpp"
+#include "common/Tools.hpp"
+#include "dinky.hpp"
+#include "parser/Parser.hpp"
+#include "renderer/Font.hpp"
+
+/*
+    dinky_check <check> [scratch dir]
+
+    Differential checks, each holding one of the faster paths to the plain one
+    it stands in for, over generated input. Run by ctest, one test per
+    entry of `checks` in main(), scratch files go in the directory given:
+
+        structural  every StructuralIndex kernel against a byte at a time scan
+        tokens      Parser::Tokenizer against a byte at a time tokenizer
+        limits      ParseOptions limits and malformed brackets fail cleanly, deep
+                    nesting within them parses
+        reparse     random edits through DNK::reparse against a full parse
+        stream      input piped in random chunks against a buffered parse
+        parallel    parsing on several threads against a serial parse
+        compiled    .dnkc round trips, and corrupted files or another source with
+                    the same hash rejected or safe to walk
+        glyphs      .dnkg round trips, metrics and kerning the same once cached, and
+                    corrupted files rejected or drawing inside their atlas
+        blit        every Blit row kernel against the scalar one, byte for byte
+
+    Documents are compared by what they hold, not by their arena layout, so
+    dead nodes left by reparse or a different node order don't count
+*/
+
+namespace Check {
+
+    static std::mt19937 rng(7);
+
+    static void describe(const DNK::Document &doc, uint32 index, unsigned depth, std::string &out){
+        auto &node = doc.arena.nodes[index];
+        char line[128];
+        snprintf(line, sizeof(line), "%*s%s |%g,%g,%g| ", depth * 2, "", DNK::NodeType::name(node.type).c_str(), node.margin, node.spacing, node.lineHeight);
+        out += line;
+        out += doc.getText(index);
+        auto attributes = [&](const char *kind, const std::vector<DNK::Attribute> &list, uint32 first, uint32 count){
+            for(uint32 i = 0; i < count; ++i){
+                auto &attr = list[first + i];
+                uint32 bits;
+                memcpy(&bits, &attr.value.number, sizeof(bits));
+                snprintf(line, sizeof(line), " %s%s=%u/%u/%08x:", kind, doc.getKeyName(attr.key).c_str(), attr.value.type, attr.value.unit, bits);
+                out += line;
+                out += doc.getSpan(attr.value.str);
+            }
+        };
+        attributes("!", doc.arena.styles, node.firstStyle, node.styleCount);
+        attributes("%", doc.arena.params, node.firstParam, node.paramCount);
+        out += '\n';
+        for(auto child = node.firstChild; child != DNK::Node::NONE; child = doc.arena.nodes[child].nextSibling){
+            describe(doc, child, depth + 1, out);
+        }
+    }
+
+    static std::string describe(const DNK::Document &doc){
+        std::string out;
+        if(doc.body != DNK::Node::NONE){
+            describe(doc, doc.body, 0, out);
+        }
+        return out;
+    }
+
+    // Blocks, styles, media and text nested up to `depth`
+    static std::string fragment(unsigned depth){
+        static const char *bits[] = {
+            "hello ", "world ", "  ", "\n", "!bold ", "!m=2 ", "!s=1 ", "!c1=x ", "!c2=#ff0000 ",
+            "%title v:'a [b] c'% ", "%text%", "%image src:'x' w:'50%'%", "'quoted' ", "!ln=3\n", "!c3=5px "
+        };
+        std::string out;
+        auto n = rng() % 6;
+        for(unsigned i = 0; i < n; ++i){
+            if(depth < 6 && rng() % 3 == 0){
+                out += "[" + fragment(depth + 1) + "]";
+            }else{
+                out += bits[rng() % (sizeof(bits) / sizeof(bits[0]))];
+            }
+        }
+        return out;
+    }
+
+    static std::string document(size_t size){
+        std::string out;
+        while(out.size() < size){
+            out += rng() % 4 == 0 ? fragment(1) : "[" + fragment(1) + "]";
+            if(rng() % 2){
+                out += "\n";
+            }
+        }
+        return out;
+    }
+
+    static std::shared_ptr<DNK::Document> parse(const std::string &src, bool &ok, const DNK::ParseOptions &options = DNK::ParseOptions()){
+        auto doc = DNK::build("check", "check", DNK::DocumentType::TYPICAL);
+        ok = DNK::parse(doc, src, options);
+        return doc;
+    }
+
+    static bool structural(const std::string &dir){
+        auto kernels = Parser::structuralKernels();
+        for(unsigned i = 0; i < 2000; ++i){
+            // every byte value, structural ones more often, any length and tail
+            std::string src(rng() % 300, '\0');
+            for(auto &c : src){
+                c = rng() % 2 ? "[]%!'"[rng() % 5] : static_cast<char>(rng());
+            }
+            std::vector<size_t> expected;
+            for(size_t at = 0; at < src.size(); ++at){
+                auto c = src[at];
+                if(c == '[' || c == ']' || c == '%' || c == '!' || c == '\''){
+                    expected.push_back(at);
+                }
+            }
+            for(auto &kernel : kernels){
+                Parser::StructuralIndex index;
+                index.build(src, kernel.block);
+                size_t offset = src.size() > 0 ? rng() % src.size() : 0;
+                auto slice = index.slice(offset, src.size() - offset);
+                size_t n = 0;
+                for(size_t at = index.next(0); at < src.size(); at = index.next(at + 1), ++n){
+                    if(n >= expected.size() || at != expected[n]){
+                        fprintf(stderr, "Check::structural: %s marks %zu of %zu bytes, expected %zu\n", kernel.name, at, src.size(), n < expected.size() ? expected[n] : src.size());
+                        return false;
+                    }
+                    // a slice sees the same positions, shifted
+                    if(at >= offset && slice.next(at - offset) != at - offset){
+                        fprintf(stderr, "Check::structural: %s slice at %zu misses %zu\n", kernel.name, offset, at);
+                        return false;
+                    }
+                }
+                if(n != expected.size()){
+                    fprintf(stderr, "Check::structural: %s found %zu structural bytes, expected %zu\n", kernel.name, n, expected.size());
+                    return false;
+                }
+            }
+        }
+        printf("structural: 2000 inputs through");
+        for(auto &kernel : kernels){
+            printf(" %s", kernel.name);
+        }
+        printf("\n");
+        return true;
+    }
+
+    // The tokenizer's rules one byte at a time, without the structural index
+    static std::vector<Parser::Token> tokenize(std::string_view input){
+        std::vector<Parser::Token> out;
+        size_t at = 0;
+        while(at < input.size()){
+            Parser::Token token;
+            token.offset = at;
+            token.str = std::string_view();
+            token.value = std::string_view();
+            auto c = input[at];
+            if(c == '['){
+                token.type = Parser::TokenType::OPEN;
+                ++at;
+            }else
+            if(c == ']'){
+                token.type = Parser::TokenType::CLOSE;
+                ++at;
+            }else
+            if(c == '%'){
+                auto end = at + 1;
+                auto quoted = false;
+                while(end < input.size() && (quoted || input[end] != '%')){
+                    quoted = input[end] == '\'' ? !quoted : quoted;
+                    ++end;
+                }
+                if(end >= input.size()){
+                    token.type = Parser::TokenType::ERROR;
+                    out.push_back(token);
+                    return out;
+                }
+                token.type = Parser::TokenType::MEDIA;
+                token.str = input.substr(at + 1, end - at - 1);
+                at = end + 1;
+            }else
+            if(c == '!'){
+                auto end = at + 1;
+                while(end < input.size() && input[end] != ' ' && input[end] != '\n' && input[end] != '[' && input[end] != ']'){
+                    ++end;
+                }
+                auto body = input.substr(at + 1, end - at - 1);
+                auto eq = body.find('=');
+                token.type = Parser::TokenType::STYLE;
+                token.str = eq == std::string_view::npos ? body : body.substr(0, eq);
+                token.value = eq == std::string_view::npos ? body.substr(body.size()) : body.substr(eq + 1);
+                if(end < input.size() && (input[end] == ' ' || input[end] == '\n')){
+                    ++end;
+                }
+                at = end;
+            }else{
+                auto end = at + 1;
+                while(end < input.size() && input[end] != '[' && input[end] != ']' && input[end] != '%' && input[end] != '!'){
+                    ++end;
+                }
+                token.type = Parser::TokenType::TEXT;
+                token.str = input.substr(at, end - at);
+                at = end;
+            }
+            out.push_back(token);
+        }
+        return out;
+    }
+
+    static bool tokens(const std::string &dir){
+        size_t count = 0;
+        for(unsigned i = 0; i < 200; ++i){
+            auto src = Check::document(rng() % 4000);
+            // stray quotes, markers and brackets too, not only what parses
+            for(unsigned k = 0; k < i % 8; ++k){
+                src.insert(rng() % (src.size() + 1), 1, "[]%!'"[rng() % 5]);
+            }
+            auto expected = Check::tokenize(src);
+            Parser::Tokenizer tokenizer(src);
+            Parser::Token token;
+            size_t n = 0;
+            while(true){
+                auto more = tokenizer.next(token);
+                if(!more && token.type == Parser::TokenType::END){
+                    break;
+                }
+                // every view points into the source, nothing was copied
+                auto inside = [&](std::string_view view){
+                    return view.size() == 0 || (view.data() >= src.data() && view.data() + view.size() <= src.data() + src.size());
+                };
+                auto &want = n < expected.size() ? expected[n] : token;
+                if(n >= expected.size() || token.type != want.type || token.offset != want.offset ||
+                    (token.type != Parser::TokenType::ERROR && (!inside(token.str) || !inside(token.value) || token.str != want.str || token.value != want.value))){
+                    fprintf(stderr, "Check::tokens: Document %u, token %zu at offset %zu differs\n", i, n, token.offset);
+                    return false;
+                }
+                ++n;
+                if(!more){
+                    break;
+                }
+            }
+            if(n != expected.size()){
+                fprintf(stderr, "Check::tokens: Document %u has %zu tokens, expected %zu\n", i, n, expected.size());
+                return false;
+            }
+            count += n;
+        }
+        printf("tokens: 200 documents, %zu tokens\n", count);
+        return true;
+    }
+
+    static bool limits(const std::string &dir){
+        struct Case {
+            const char *name;
+            std::string src;
+            DNK::ParseOptions options;
+            bool ok;
+        };
+        std::vector<Case> cases;
+        auto add = [&](const char *name, const std::string &src, bool ok){
+            cases.push_back(Case { name, src, DNK::ParseOptions(), ok });
+            return &cases.back().options;
+        };
+        std::string deep = std::string(100000, '[') + "a" + std::string(100000, ']');
+        add("stray ']' at the root", "[a] b]", false);
+        add("stray ']' first", "]", false);
+        add("unclosed '['", "[a [b]", false);
+        add("unterminated media", "[%image src:'x']", false);
+        add("quoted '%' in media", "[%image src:'50%'%]", true);
+        add("nested up to maxDepth", "[[[a]]]", true)->maxDepth = 3;
+        add("nested past maxDepth", "[[[[a]]]]", false)->maxDepth = 3;
+        add("100000 levels, default maxDepth", deep, false);
+        add("100000 levels within maxDepth", deep, true)->maxDepth = 100000;
+        add("at maxSize", "[abc]", true)->maxSize = 5;
+        add("past maxSize", "[abcd]", false)->maxSize = 5;
+        add("past maxNodes", "[a][b][c][d]", false)->maxNodes = 3;
+        add("within maxNodes", "[a][b]", true)->maxNodes = 3;
+        for(auto &c : cases){
+            for(unsigned threads : { 1u, 4u }){
+                auto options = c.options;
+                options.threads = threads;
+                bool ok;
+                auto doc = Check::parse(c.src, ok, options);
+                if(ok != c.ok){
+                    fprintf(stderr, "Check::limits: '%s' %s on %u threads\n", c.name, ok ? "parsed" : "failed", threads);
+                    return false;
+                }
+                if(!ok && (doc->body != DNK::Node::NONE || doc->arena.nodes.size() > 0)){
+                    fprintf(stderr, "Check::limits: '%s' left a partial tree\n", c.name);
+                    return false;
+                }
+            }
+        }
+        printf("limits: %zu cases\n", cases.size());
+        return true;
+    }
+
+    static bool reparse(const std::string &dir){
+        static const char *inserts[] = { "a", "b", " ", "\n", "!bold ", "!m=2 ", "x", "[", "]", "%", "'", "[q]", "!k=v ", "!zz ", "" };
+        bool ok;
+        auto doc = Check::parse(Check::document(2000), ok);
+        unsigned edits = 0;
+        for(unsigned i = 0; i < 1500; ++i){
+            std::string text(doc->arena.text());
+            uint32 offset = rng() % (text.size() + 1);
+            uint32 removed = std::min<uint32>(rng() % 4, text.size() - offset);
+            std::string inserted = inserts[rng() % (sizeof(inserts) / sizeof(inserts[0]))];
+            auto next = text.substr(0, offset) + inserted + text.substr(offset + removed);
+            auto full = Check::parse(next, ok);
+            // an edit that breaks the document isn't applied
+            if(!ok){
+                continue;
+            }
+            if(!DNK::reparse(doc, DNK::Edit(offset, removed, inserted)) || doc->arena.text() != next || Check::describe(*doc) != Check::describe(*full)){
+                fprintf(stderr, "Check::reparse: Edit %u (%u bytes at %u, '%s') differs from a full parse\n", i, removed, offset, inserted.c_str());
+                return false;
+            }
+            ++edits;
+        }
+        printf("reparse: %u edits, %u dead nodes\n", edits, doc->arena.dead);
+        return true;
+    }
+
+    static bool stream(const std::string &dir){
+        unsigned parsed = 0;
+        for(unsigned i = 0; i < 40; ++i){
+            auto src = Check::document(1 + rng() % 20000);
+            if(i % 4 == 1){
+                src = "[" + src + "]";
+            }
+            bool ok;
+            auto buffered = Check::parse(src, ok);
+            int pipes[2];
+            if(pipe(pipes) != 0){
+                fprintf(stderr, "Check::stream: Failed to create a pipe\n");
+                return false;
+            }
+            auto seed = rng();
+            std::thread writer([&](){
+                std::mt19937 chunks(seed);
+                for(size_t at = 0; at < src.size();){
+                    auto n = std::min<size_t>(1 + chunks() % 64, src.size() - at);
+                    auto wrote = write(pipes[1], src.data() + at, n);
+                    if(wrote <= 0){
+                        break;
+                    }
+                    at += wrote;
+                }
+                close(pipes[1]);
+            });
+            auto streamed = DNK::build("check", "check", DNK::DocumentType::TYPICAL);
+            auto streamedOk = DNK::parse(streamed, pipes[0]);
+            writer.join();
+            close(pipes[0]);
+            if(ok != streamedOk || (ok && Check::describe(*buffered) != Check::describe(*streamed))){
+                fprintf(stderr, "Check::stream: Document %u (%zu bytes) streams differently than it parses\n", i, src.size());
+                return false;
+            }
+            if(!ok){
+                continue;
+            }
+            ++parsed;
+            // without a sink every block comes out of the parser's own buffer, and
+            // the blocks plus the root, where each left a break, make up the input
+            DNK::StreamParser parser;
+            size_t blocks = 0;
+            size_t bytes = 0;
+            parser.onBlock = [&](const DNK::Document &block){
+                auto text = block.arena.text();
+                ++blocks;
+                bytes += text.size();
+                return text.size() > 1 && text.front() == '[' && text.back() == ']';
+            };
+            for(size_t at = 0; at < src.size();){
+                auto n = std::min<size_t>(1 + rng() % 64, src.size() - at);
+                if(!parser.push(src.data() + at, n)){
+                    fprintf(stderr, "Check::stream: Document %u fails when pushed without a sink\n", i);
+                    return false;
+                }
+                at += n;
+            }
+            DNK::Document root;
+            if(!parser.finish(root) || bytes + root.arena.text().size() - blocks != src.size()){
+                fprintf(stderr, "Check::stream: Document %u loses bytes when pushed without a sink\n", i);
+                return false;
+            }
+        }
+        printf("stream: 40 documents, %u parsed\n", parsed);
+        return true;
+    }
+
+    static bool parallel(const std::string &dir){
+        unsigned parsed = 0;
+        for(unsigned i = 0; i < 12; ++i){
+            // big enough to be split, sometimes behind wrappers or broken
+            auto src = Check::document(300 * 1024);
+            for(unsigned k = 0; k < i % 4; ++k){
+                src = (k % 2 ? " \n[" : "[") + src + "]\n";
+            }
+            if(i % 5 == 3){
+                src = "!m=1 " + src;
+            }
+            if(i % 7 == 5){
+                src += "]";
+            }
+            DNK::ParseOptions threaded;
+            threaded.threads = 2 + i % 7;
+            bool serialOk, threadedOk;
+            auto serial = Check::parse(src, serialOk);
+            auto split = Check::parse(src, threadedOk, threaded);
+            if(serialOk != threadedOk || (serialOk && Check::describe(*serial) != Check::describe(*split))){
+                fprintf(stderr, "Check::parallel: Document %u differs on %u threads\n", i, threaded.threads);
+                return false;
+            }
+            parsed += serialOk;
+        }
+        printf("parallel: 12 documents, %u parsed\n", parsed);
+        return true;
+    }
+
+    static std::string readFile(const std::string &path){
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream bytes;
+        bytes << file.rdbuf();
+        return bytes.str();
+    }
+
+    static bool compiled(const std::string &dir){
+        auto path = dir + DNK::File::dirSep() + "check.dnkc";
+        auto corrupt = dir + DNK::File::dirSep() + "corrupt.dnkc";
+        unsigned rejected = 0;
+        for(unsigned i = 0; i < 4; ++i){
+            bool ok;
+            auto doc = Check::parse(Check::document(20000), ok);
+            // reparsed documents carry dead nodes into the file
+            for(unsigned e = 0; i % 2 == 1 && e < 20; ++e){
+                DNK::reparse(doc, DNK::Edit(rng() % doc->arena.text().size(), 0, "x"));
+            }
+            std::string source(doc->arena.text());
+            if(!DNK::writeCompiled(doc, path, i)){
+                return false;
+            }
+            auto bytes = Check::readFile(path);
+            auto read = DNK::build("check", "check", DNK::DocumentType::TYPICAL);
+            if(!DNK::readCompiled(read, path, i, source) || Check::describe(*read) != Check::describe(*doc)){
+                fprintf(stderr, "Check::compiled: Document %u doesn't read back as written\n", i);
+                return false;
+            }
+            if(!DNK::writeCompiled(read, path, i) || Check::readFile(path) != bytes){
+                fprintf(stderr, "Check::compiled: Document %u isn't written the same twice\n", i);
+                return false;
+            }
+            // a hash match alone, as a forged or colliding source would have, isn't enough
+            auto other = source;
+            other[rng() % other.size()] ^= 1;
+            auto forged = DNK::build("check", "check", DNK::DocumentType::TYPICAL);
+            if(DNK::readCompiled(forged, path, i, other) || DNK::readCompiled(forged, path, i, source + " ")){
+                fprintf(stderr, "Check::compiled: Document %u is read for another source with the same hash\n", i);
+                return false;
+            }
+            for(unsigned c = 0; c < 100; ++c){
+                auto changed = bytes;
+                for(unsigned k = 0; k <= c % 4; ++k){
+                    changed[rng() % changed.size()] = rng();
+                }
+                std::ofstream(corrupt, std::ios::binary) << changed;
+                auto x = DNK::build("check", "check", DNK::DocumentType::TYPICAL);
+                if(!DNK::readCompiled(x, corrupt, i, source)){
+                    ++rejected;
+                    continue;
+                }
+                // whatever got through must be safe to lay out
+                Check::describe(*x);
+            }
+        }
+        remove(path.c_str());
+        remove(corrupt.c_str());
+        printf("compiled: 4 documents, %u of 400 corrupted copies rejected\n", rejected);
+        return true;
+    }
+
+    static bool glyphs(const std::string &dir){
+        // not a baked size, so the glyph cache is what's being read
+        static const char *file = "lib/font/arial.ttf";
+        static const unsigned size = 17;
+        static const char *asked[] = { "AVAWAYToTaTe", "Hello, world", "Ωmega élan" };
+        static const char *later = "LTLYPAyoFA";
+        std::vector<unsigned> widths;
+        {
+            FontRender::Registry registry;
+            if(!registry.load("check", file, size, dir, FontRender::GlyphMode::COVERAGE, FontRender::FontWeight::REGULAR)){
+                return false;
+            }
+            auto font = registry.find("check");
+            for(auto text : asked){
+                widths.push_back(FontRender::getDimensions(*font, text).x);
+            }
+            registry.flush();
+            // measured after the cache was written, so its pairs are asked again
+            widths.push_back(FontRender::getDimensions(*font, later).x);
+        }
+        std::string cache;
+        uint32 record[2] = { 'A', 0 };
+        {
+            FontRender::Registry registry;
+            if(!registry.load("check", file, size, dir, FontRender::GlyphMode::COVERAGE, FontRender::FontWeight::REGULAR)){
+                return false;
+            }
+            auto font = registry.find("check");
+            cache = font->cache;
+            record[1] = FontRender::glyph(*font, 'A')->glyph;
+            if(!font->storage){
+                fprintf(stderr, "Check::glyphs: '%s' wasn't read back\n", cache.c_str());
+                return false;
+            }
+            for(unsigned i = 0; i < widths.size(); ++i){
+                auto text = i < widths.size() - 1 ? asked[i] : later;
+                if(FontRender::getDimensions(*font, text).x != widths[i]){
+                    fprintf(stderr, "Check::glyphs: '%s' is %u wide cached, %u before\n", text, FontRender::getDimensions(*font, text).x, widths[i]);
+                    return false;
+                }
+            }
+        }
+
+        // a corrupted cache is either turned down or every glyph it hands out
+        // lies inside the mapping, with tables kern() can search
+        auto bytes = Check::readFile(cache);
+        auto at = bytes.find(std::string(reinterpret_cast<const char*>(record), sizeof(record)));
+        if(at == std::string::npos){
+            fprintf(stderr, "Check::glyphs: No record for 'A' in '%s'\n", cache.c_str());
+            return false;
+        }
+        unsigned rejected = 0;
+        for(unsigned c = 0; c < 60; ++c){
+            auto changed = bytes;
+            // the first one moves 'A' so far right that x + w wraps around
+            if(c == 0){
+                uint32 x = 0xFFFFFFF0u;
+                memcpy(&changed[at + offsetof(FontRender::GlyphRecord, x)], &x, sizeof(x));
+            }
+            for(unsigned k = 0; c > 0 && k <= c % 4; ++k){
+                changed[rng() % changed.size()] = rng();
+            }
+            std::ofstream(cache, std::ios::binary) << changed;
+            FontRender::Registry registry;
+            if(!registry.load("check", file, size, dir, FontRender::GlyphMode::COVERAGE, FontRender::FontWeight::REGULAR)){
+                return false;
+            }
+            auto font = registry.find("check");
+            if(!font->storage){
+                ++rejected;
+                continue;
+            }
+            if(c == 0){
+                fprintf(stderr, "Check::glyphs: A record whose x + w wraps was read\n");
+                return false;
+            }
+            auto begin = reinterpret_cast<const uint8*>(font->storage->data);
+            auto end = begin + font->storage->size;
+            for(auto &g : font->map){
+                auto &glyph = *g.second;
+                if(glyph.box.w > 0 && (glyph.pixels < begin || glyph.pixels + (glyph.box.h - 1) * glyph.pitch + glyph.box.w > end)){
+                    fprintf(stderr, "Check::glyphs: Corrupted copy %u hands out glyph %u outside its atlas\n", c, glyph.glyph);
+                    return false;
+                }
+            }
+            auto byPair = [](const FontRender::KernPair &a, const FontRender::KernPair &b){
+                return a.pair < b.pair;
+            };
+            if(!std::is_sorted(font->kerning.begin(), font->kerning.end(), byPair) || !std::is_sorted(font->common.begin(), font->common.end())){
+                fprintf(stderr, "Check::glyphs: Corrupted copy %u was read with unsorted tables\n", c);
+                return false;
+            }
+        }
+        remove(cache.c_str());
+        printf("glyphs: %zu runs the same from '%s', %u of 60 corrupted copies rejected\n", widths.size(), cache.c_str(), rejected);
+        return true;
+    }
+
+    static bool blit(const std::string &dir){
+        auto kernels = Blit::rowKernels();
+        auto &scalar = kernels.front();
+        for(unsigned i = 0; i < 3000; ++i){
+            // never a whole number of vectors, so the tails run too, at any alignment
+            unsigned n = rng() % 131;
+            if(n % 4 == 0){
+                n += 1 + rng() % 3;
+            }
+            unsigned at = rng() % 16;
+            std::vector<uint8> src(at + n * 4), coverage(at + n), dst(at + n * 4 + 32);
+            for(auto *bytes : { &src, &coverage, &dst }){
+                for(auto &b : *bytes){
+                    // opaque and clear pixels and full coverage come up often
+                    b = rng() % 4 == 0 ? (rng() % 2 ? 255 : 0) : rng();
+                }
+            }
+            float tint[3];
+            for(auto &t : tint){
+                t = (rng() % 1001) / 1000.0f;
+            }
+            auto over = dst, covered = dst;
+            scalar.over(over.data() + at, src.data() + at, n, tint);
+            scalar.coverage(covered.data() + at, coverage.data() + at, n, tint);
+            for(auto &kernel : kernels){
+                auto got = dst;
+                kernel.over(got.data() + at, src.data() + at, n, tint);
+                if(got != over){
+                    fprintf(stderr, "Check::blit: %s over differs from scalar on a row of %u\n", kernel.name, n);
+                    return false;
+                }
+                got = dst;
+                kernel.coverage(got.data() + at, coverage.data() + at, n, tint);
+                if(got != covered){
+                    fprintf(stderr, "Check::blit: %s coverage differs from scalar on a row of %u\n", kernel.name, n);
+                    return false;
+                }
+            }
+        }
+        printf("blit: 3000 rows through");
+        for(auto &kernel : kernels){
+            printf(" %s", kernel.name);
+        }
+        printf("\n");
+        return true;
+    }
+
+}
+
+int main(int argc, char* argv[]){
+    struct Entry {
+        const char *name;
+        bool (*run)(const std::string &dir);
+    };
+    static const Entry checks[] = {
+        { "structural", Check::structural },
+        { "tokens", Check::tokens },
+        { "limits", Check::limits },
+        { "reparse", Check::reparse },
+        { "stream", Check::stream },
+        { "parallel", Check::parallel },
+        { "compiled", Check::compiled },
+        { "glyphs", Check::glyphs },
+        { "blit", Check::blit },
+    };
+    if(argc < 2){
+        fprintf(stderr, "usage: dinky_check <check> [scratch dir]\n");
+        return 1;
+    }
+    std::string check = argv[1];
+    std::string dir = argc > 2 ? argv[2] : ".";
+    for(auto &entry : checks){
+        if(check == entry.name){
+            return entry.run(dir) ? 0 : 1;
+        }
+    }
+    fprintf(stderr, "dinky_check: Unknown check '%s'\n", check.c_str());
+    return 1;
+}
@@ -5,9 +5,183 @@
 #include "./thirdparty/stb_image.h"
 #include "./thirdparty/stb_image_write.h"
 #include "./Tools.hpp"
+#include "./Blit.hpp"
 
 #include "Bitmap.hpp"
 
+namespace BitmapFormat {
+
+    // Same truncation write() always used, so a pixel blended once comes out as
+    // it did when pixels were floats
+    static inline uint8 toByte(float v){
+        return static_cast<uint8>(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+    }
+
+    // Where R, G, B and A sit in a pixel of N bytes, -1 when the format lacks it
+    template<int R, int G, int B, int A, unsigned N>
+    struct Layout {
+        static const unsigned CHANNELS = N;
+
+        template<int I>
+        static float channel(const uint8 *p, float missing){
+            if constexpr(I >= 0){
+                return p[I] / 255.0f;
+            }else{
+                return missing;
+            }
+        }
+
+        template<int I>
+        static void setChannel(uint8 *p, float v){
+            if constexpr(I >= 0){
+                p[I] = toByte(v);
+            }
+        }
+
+        // src * a + dst * (1 - a), the colour channels of every blend below
+        template<int I>
+        static void blendChannel(uint8 *p, float src, float a){
+            if constexpr(I >= 0){
+                p[I] = toByte((src * a) + ((p[I] / 255.0f) * (1.0f - a)));
+            }
+        }
+
+        static DNK::Color read(const uint8 *p){
+            return DNK::Color(channel<R>(p, 0.0f), channel<G>(p, 0.0f), channel<B>(p, 0.0f), channel<A>(p, 1.0f));
+        }
+
+        static void write(uint8 *p, const DNK::Color &c){
+            setChannel<R>(p, c.r);
+            setChannel<G>(p, c.g);
+            setChannel<B>(p, c.b);
+            setChannel<A>(p, c.a);
+        }
+
+        // targets are treated as opaque, as they always were
+        static void blend(uint8 *p, float r, float g, float b, float a){
+            blendChannel<R>(p, r, a);
+            blendChannel<G>(p, g, a);
+            blendChannel<B>(p, b, a);
+            setChannel<A>(p, 1.0f);
+        }
+
+        static float alpha(const uint8 *p){
+            return channel<A>(p, 1.0f);
+        }
+    };
+
+    // Runs `op` with the Layout of `format`, so per-pixel code is compiled once
+    // per format and picked once per call
+    template<typename Op>
+    static void with(unsigned format, Op &&op){
+        switch(format){
+            case DNK::ImageFormat::RED: {
+                op(Layout<0, -1, -1, -1, 1>());
+            } break;
+            case DNK::ImageFormat::GREEN: {
+                op(Layout<-1, 0, -1, -1, 1>());
+            } break;
+            case DNK::ImageFormat::BLUE: {
+                op(Layout<-1, -1, 0, -1, 1>());
+            } break;
+            case DNK::ImageFormat::RG: {
+                op(Layout<0, 1, -1, -1, 2>());
+            } break;
+            case DNK::ImageFormat::RGB: {
+                op(Layout<0, 1, 2, -1, 3>());
+            } break;
+            case DNK::ImageFormat::A: {
+                op(Layout<-1, -1, -1, 0, 1>());
+            } break;
+            default:
+            case DNK::ImageFormat::RGBA: {
+                op(Layout<0, 1, 2, 3, 4>());
+            } break;
+        }
+    }
+
+}
+
+DNK::Color DNK::Bitmap::get(unsigned x, unsigned y) const {
+    DNK::Color c;
+    BitmapFormat::with(this->format, [&](auto layout){
+        c = decltype(layout)::read(&this->pixels[(x + y * this->width) * this->channels]);
+    });
+    return c;
+}
+
+void DNK::Bitmap::set(unsigned x, unsigned y, const DNK::Color &c){
+    BitmapFormat::with(this->format, [&](auto layout){
+        decltype(layout)::write(&this->pixels[(x + y * this->width) * this->channels], c);
+    });
+}
+
+DNK::Rect<unsigned> DNK::Bitmap::clip(int x, int y, int w, int h) const {
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = std::min(x + w, (int)this->width);
+    int y1 = std::min(y + h, (int)this->height);
+    if(x0 >= x1 || y0 >= y1){
+        return DNK::Rect<unsigned>(0, 0, 0, 0);
+    }
+    return DNK::Rect<unsigned>(x0, y0, x1 - x0, y1 - y0);
+}
+
+void DNK::Bitmap::fillSpan(unsigned x, unsigned y, unsigned n, const DNK::Color &c){
+    if(n == 0){
+        return;
+    }
+    auto to = &this->pixels[(x + y * this->width) * this->channels];
+    this->set(x, y, c);
+    // doubles what is already filled until the span is covered
+    size_t done = this->channels;
+    size_t total = (size_t)n * this->channels;
+    while(done < total){
+        auto step = std::min(done, total - done);
+        memcpy(to + done, to, step);
+        done += step;
+    }
+}
+
+void DNK::Bitmap::copySpan(unsigned x, unsigned y, unsigned n, const uint8 *src){
+    auto to = &this->pixels[(x + y * this->width) * this->channels];
+    if(this->channels == 4){
+        Blit::copyRow(to, src, n);
+    }else{
+        memcpy(to, src, (size_t)n * this->channels);
+    }
+}
+
+void DNK::Bitmap::blendSpan(unsigned x, unsigned y, unsigned n, const uint8 *src, const DNK::Color &tint){
+    BitmapFormat::with(this->format, [&](auto layout){
+        typedef decltype(layout) L;
+        auto to = &this->pixels[(x + y * this->width) * L::CHANNELS];
+        if constexpr(L::CHANNELS == 4){
+            Blit::overRow(to, src, n, tint);
+        }else{
+            for(unsigned i = 0; i < n; ++i){
+                auto s = L::read(src + i * L::CHANNELS);
+                L::blend(to + i * L::CHANNELS, s.r * tint.r, s.g * tint.g, s.b * tint.b, s.a);
+            }
+        }
+    });
+}
+
+void DNK::Bitmap::coverageSpan(unsigned x, unsigned y, unsigned n, const uint8 *coverage, const DNK::Color &c){
+    BitmapFormat::with(this->format, [&](auto layout){
+        typedef decltype(layout) L;
+        auto to = &this->pixels[(x + y * this->width) * L::CHANNELS];
+        if constexpr(L::CHANNELS == 4){
+            Blit::coverageRow(to, coverage, n, c);
+        }else{
+            for(unsigned i = 0; i < n; ++i){
+                float srcAlpha = coverage[i] / 255.0f;
+                L::blend(to + i * L::CHANNELS, srcAlpha * c.r, srcAlpha * c.g, srcAlpha * c.b, srcAlpha);
+            }
+        }
+    });
+}
+
 DNK::Bitmap DNK::Bitmap::sub(const DNK::Rect<unsigned> &box){
     return this->sub(box.x, box.y, box.w, box.h);
 }
@@ -16,11 +190,8 @@ DNK::Bitmap DNK::Bitmap::sub(unsigned x, unsigned y, unsigned width, unsigned he
     DNK::Bitmap result;
     result.build(DNK::Color(0, 0, 0, 0), this->format, width, height);
     
-    for(unsigned _x = 0; _x < width; ++_x){
-        for(unsigned _y = 0; _y < height; ++_y){
-            result.pixels[_x + _y * width] = this->pixels[(_x+x) + (_y+y) * this->width];
-        }
-        
+    for(unsigned _y = 0; _y < height; ++_y){
+        result.copySpan(0, _y, width, &this->pixels[(x + (_y + y) * this->width) * channels]);
     }
     
     return result;
@@ -36,8 +207,8 @@ DNK::Bitmap DNK::Bitmap::rotate(float angle){
     auto result = DNK::Bitmap();
     result.build(DNK::Color(1.0f, 1.0f, 1.0f, 0.0f), this->format, nW, nH);
     
-    for(int _x = 0; _x < this->width; ++_x){
-        for(int _y = 0; _y < this->height; ++_y){
+    for(int _y = 0; _y < this->height; ++_y){
+        for(int _x = 0; _x < this->width; ++_x){
             
             int srcIndex = (_x + _y * this->width);
             
@@ -51,12 +222,15 @@ DNK::Bitmap DNK::Bitmap::rotate(float angle){
             double rX = DNK::Math::cos(rangle + angle) * rmod;
             double rY = DNK::Math::sin(rangle + angle) * rmod;
             
-            double fX = DNK::Math::round(rX + ((double)result.width-1.0) * 0.5);
-            double fY = DNK::Math::round(rY + ((double)result.height-1.0) * 0.5);  
+            int fX = DNK::Math::round(rX + ((double)result.width-1.0) * 0.5);
+            int fY = DNK::Math::round(rY + ((double)result.height-1.0) * 0.5);  
+            if(fX < 0 || fX >= result.width || fY < 0 || fY >= result.height){
+                continue;
+            }
             
-            int index = ((int)fX + (int)fY * result.width);
+            int index = (fX + fY * result.width);
             
-            result.pixels[index] = this->pixels[srcIndex];
+            memcpy(&result.pixels[index * channels], &this->pixels[srcIndex * channels], channels);
         }
     }		
     
@@ -65,17 +239,13 @@ DNK::Bitmap DNK::Bitmap::rotate(float angle){
 }
 
 void DNK::Bitmap::shade(const DNK::Color &color){
-    for(unsigned i = 0; i < this->pixels.size(); ++i){
-        auto &p = this->pixels[i];
-        switch(this->format){
-            case ImageFormat::RGBA: {
-                p.r *= color.r;
-                p.g *= color.g;
-                p.b *= color.b;
-                p.a *= color.a;
-            } break;
+    BitmapFormat::with(this->format, [&](auto layout){
+        typedef decltype(layout) L;
+        for(size_t i = 0; i < this->pixels.size(); i += L::CHANNELS){
+            auto p = L::read(&this->pixels[i]);
+            L::write(&this->pixels[i], DNK::Color(p.r * color.r, p.g * color.g, p.b * color.b, p.a * color.a));
         }
-    }    
+    });
 }
 
 void DNK::Bitmap::resize(unsigned nwidth, unsigned nheight){
@@ -90,32 +260,59 @@ void DNK::Bitmap::pasteAndShade(Bitmap *src, unsigned x, unsigned y, const DNK::
         printf("Bitmap paste: Cannot paste a Bitmap onto another Bitmap of a differing image format\n");
         return;
     }
-    for(int _x = 0; _x < src->width; ++_x){
-        for(int _y = 0; _y < src->height; ++_y){
-            
-            if(_x + x >= this->width || _y + y >= this->height) continue;
-            
-            int srcIndex = (_x + _y * src->width);
-            int index = (_x + x + (_y + y) * width);
-            
-            if(channels == 4) {
-                float srcRed = src->pixels[srcIndex].r * c.r;
-                float srcGreen = src->pixels[srcIndex].g * c.g;
-                float srcBlue =  src->pixels[srcIndex].b * c.b;
-                float srcAlpha = src->pixels[srcIndex].a;
-                
-                float targetRed = this->pixels[index].r;
-                float targetGreen = this->pixels[index].g;
-                float targetBlue = this->pixels[index].b;
-                
-                this->pixels[index].r = (srcRed * srcAlpha) + (targetRed * (1.0f - srcAlpha));
-                this->pixels[index].g = (srcGreen * srcAlpha) + (targetGreen * (1.0f - srcAlpha));
-                this->pixels[index].b = (srcBlue * srcAlpha) + (targetBlue * (1.0f - srcAlpha));
-                this->pixels[index].a = 1.0f;
+    // x and y may have wrapped from negative offsets, the source is cut by what
+    // the clip took off the left and top
+    auto r = this->clip(x, y, src->width, src->height);
+    unsigned sx = r.x - (int)x;
+    unsigned sy = r.y - (int)y;
+    for(unsigned _y = 0; _y < r.h; ++_y){
+        this->blendSpan(r.x, r.y + _y, r.w, &src->pixels[(sx + (sy + _y) * src->width) * src->channels], c);
+    }
+}
+
+void DNK::Bitmap::pasteMask(const uint8 *mask, unsigned pitch, unsigned w, unsigned h, int x, int y, const DNK::Color &c){
+    auto r = this->clip(x, y, w, h);
+    for(unsigned _y = r.y; _y < r.y + r.h; ++_y){
+        this->coverageSpan(r.x, _y, r.w, mask + (_y - y) * pitch + (r.x - x), c);
+    }
+}
+
+void DNK::Bitmap::pasteField(const uint8 *field, unsigned pitch, unsigned w, unsigned h, float x, float y, float scale, float spread, const DNK::Color &c){
+    if(w == 0 || h == 0 || scale <= 0.0f){
+        return;
+    }
+    int fx = (int)std::floor(x);
+    int fy = (int)std::floor(y);
+    auto r = this->clip(fx, fy, (int)std::ceil(x + w * scale) - fx, (int)std::ceil(y + h * scale) - fy);
+    // field steps to destination pixels, the edge is antialiased over one of them
+    float toPixels = spread / 128.0f * scale;
+    auto sample = [&](int u, int v){
+        u = std::min(std::max(u, 0), (int)w - 1);
+        v = std::min(std::max(v, 0), (int)h - 1);
+        return (float)field[u + v * pitch];
+    };
+    BitmapFormat::with(this->format, [&](auto layout){
+        typedef decltype(layout) L;
+        for(int _y = r.y; _y < (int)(r.y + r.h); ++_y){
+            float v = (_y + 0.5f - y) / scale - 0.5f;
+            int v0 = (int)std::floor(v);
+            float fv = v - v0;
+            auto dst = &this->pixels[_y * this->width * L::CHANNELS];
+            for(int _x = r.x; _x < (int)(r.x + r.w); ++_x){
+                float u = (_x + 0.5f - x) / scale - 0.5f;
+                int u0 = (int)std::floor(u);
+                float fu = u - u0;
+                float top = sample(u0, v0) + (sample(u0 + 1, v0) - sample(u0, v0)) * fu;
+                float bottom = sample(u0, v0 + 1) + (sample(u0 + 1, v0 + 1) - sample(u0, v0 + 1)) * fu;
+                float distance = (top + (bottom - top) * fv - 128.0f) * toPixels;
+                float srcAlpha = std::min(std::max(distance + 0.5f, 0.0f), 1.0f);
+                if(srcAlpha == 0.0f){
+                    continue;
+                }
+                L::blend(dst + _x * L::CHANNELS, srcAlpha * c.r, srcAlpha * c.g, srcAlpha * c.b, srcAlpha);
             }
-            
         }
-    }
+    });
 }
 
 void DNK::Bitmap::paste(Bitmap *src, unsigned x, unsigned y, bool alphaBlend){
@@ -123,90 +320,35 @@ void DNK::Bitmap::paste(Bitmap *src, unsigned x, unsigned y, bool alphaBlend){
         printf("Bitmap paste: Cannot paste a Bitmap onto another Bitmap of a differing image format\n");
         return;
     }
-    for(int _x = 0; _x < src->width; ++_x){
-        for(int _y = 0; _y < src->height; ++_y){
-            
-            if(_x + x >= this->width || _y + y >= this->height) continue;
-            
-            int srcIndex = (_x + _y * src->width);
-            int index = (_x + x + (_y + y) * width);
-            
-            if(alphaBlend && channels == 4) {
-                float srcRed = src->pixels[srcIndex].r;
-                float srcGreen = src->pixels[srcIndex].g;
-                float srcBlue =  src->pixels[srcIndex].b;
-                float srcAlpha = src->pixels[srcIndex].a;
-                
-                float targetRed = this->pixels[index].r;
-                float targetGreen = this->pixels[index].g;
-                float targetBlue = this->pixels[index].b;
-                
-                this->pixels[index].r = (srcRed * srcAlpha) + (targetRed * (1.0f - srcAlpha));
-                this->pixels[index].g = (srcGreen * srcAlpha) + (targetGreen * (1.0f - srcAlpha));
-                this->pixels[index].b = (srcBlue * srcAlpha) + (targetBlue * (1.0f - srcAlpha));
-                this->pixels[index].a = 1.0f;
-            }else {									
-                if(index < 0 || srcIndex < 0 || index > this->pixels.size() || srcIndex > src->pixels.size()) {
-                    continue;
-                }
-
-                this->pixels[index] = src->pixels[srcIndex];
-            }
-            
+    auto r = this->clip(x, y, src->width, src->height);
+    unsigned sx = r.x - (int)x;
+    unsigned sy = r.y - (int)y;
+    for(unsigned _y = 0; _y < r.h; ++_y){
+        auto from = &src->pixels[(sx + (sy + _y) * src->width) * src->channels];
+        // opaque pixels blend to exactly themselves, so white is a plain blend
+        if(alphaBlend){
+            this->blendSpan(r.x, r.y + _y, r.w, from, DNK::Colors::White);
+        }else{
+            this->copySpan(r.x, r.y + _y, r.w, from);
         }
     }
 }
 
 void DNK::Bitmap::fill(DNK::Color &c){
-    for(int i = 0; i < this->pixels.size(); ++i){
-        this->pixels[i] = c;
+    if(this->pixels.size() == 0){
+        return;
+    }
+    for(unsigned y = 0; y < this->height; ++y){
+        this->fillSpan(0, y, this->width, c);
     }
 }
 
 std::vector<uint8>  DNK::Bitmap::getFlatArray() const {
-    std::vector<uint8> pixels;
-    for(unsigned i = 0; i < this->pixels.size(); ++i){
-        auto p = this->pixels[i].rgb();
-        switch(this->format){
-            case ImageFormat::RGBA: {
-                pixels.push_back(p[0]);
-                pixels.push_back(p[1]);
-                pixels.push_back(p[2]);
-                pixels.push_back(p[3]);
-            } break;
-            case ImageFormat::RGB: {
-                pixels.push_back(p[0]);
-                pixels.push_back(p[1]);
-                pixels.push_back(p[2]);
-            } break;     
-            case ImageFormat::RED: {
-                pixels.push_back(p[0]);
-            } break;   
-            case ImageFormat::GREEN: {
-                pixels.push_back(p[1]);
-            } break; 
-            case ImageFormat::BLUE: {
-                pixels.push_back(p[2]);
-            } break;      
-            case ImageFormat::RG: {
-                pixels.push_back(p[0]);
-                pixels.push_back(p[1]);
-            } break;                                                    
-        } 
-    }
-    return pixels;
+    return this->pixels;
 }
 
 DNK::Bitmap DNK::Bitmap::copy(){
-    DNK::Bitmap result;
-    result.width = this->width;
-    result.height = this->height;
-    result.format = this->format;
-    result.channels = this->channels;
-    for(unsigned i = 0; i < this->width * this->height; ++i){
-        result.pixels[i] = this->pixels[i];
-    }
-    return result;
+    return *this;
 }
 
 DNK::Rect<unsigned> DNK::Bitmap::autocrop(){
@@ -217,9 +359,7 @@ DNK::Rect<unsigned> DNK::Bitmap::autocrop(){
     
     for(unsigned y = 0; y < this->height; ++y){
         for(unsigned x = 0; x < this->width; ++x){
-            unsigned i = x + y * this->width;
-            auto &p = this->pixels[i];
-            if(p.a != 0){
+            if(this->get(x, y).a != 0){
                 min_x = std::min(min_x, x);
                 min_y = std::min(min_y, y);		
                 max_x = std::max(max_x, x);
@@ -243,11 +383,10 @@ DNK::Bitmap &DNK::Bitmap::build(const DNK::Color &p, unsigned format, unsigned w
     this->width = width;
     this->height = height;
     this->format = format;
-    this->channels = format == DNK::ImageFormat::RGBA ? 4 : 3;
-    this->pixels.resize(width * height);
-    for(unsigned i = 0; i < this->width * this->height; ++i){
-        this->pixels[i] = p;
-    }
+    this->channels = DNK::ImageFormat::getChannels(format);
+    this->pixels.resize(width * height * this->channels);
+    auto c = p;
+    this->fill(c);
     return *this;
 }
 
@@ -262,8 +401,7 @@ std::vector<std::vector<DNK::Rect<unsigned>>> DNK::Bitmap::findBoxes(){
         
         auto is_row_emty = [&](unsigned y){
             for(unsigned x = 0; x < sw; ++x){
-                auto &p = this->pixels[(x+fx) + (y+fy) * this->width];
-                if(p.a != 0){
+                if(this->get(x+fx, y+fy).a != 0){
                     return false;
                 }
             }
@@ -275,8 +413,7 @@ std::vector<std::vector<DNK::Rect<unsigned>>> DNK::Bitmap::findBoxes(){
                 if(is_row_emty(y)){
                     continue;
                 }
-                auto &p = this->pixels[(x+fx) + (y+fy) * this->width];
-                if(p.a != 0){
+                if(this->get(x+fx, y+fy).a != 0){
                     min_x = std::min(min_x, x);
                     min_y = std::min(min_y, y);		
                     max_x = std::max(max_x, x);
@@ -300,8 +437,7 @@ std::vector<std::vector<DNK::Rect<unsigned>>> DNK::Bitmap::findBoxes(){
     
     auto is_row_emty = [&](unsigned y){
         for(unsigned x = 0; x < this->width; ++x){
-            auto &p = this->pixels[x + y * this->width];
-            if(p.a != 0){
+            if(this->get(x, y).a != 0){
                 return false;
             }
         }
@@ -317,8 +453,7 @@ std::vector<std::vector<DNK::Rect<unsigned>>> DNK::Bitmap::findBoxes(){
         
         auto is_column_emty = [&](unsigned x){
             for(unsigned y = stY; y < stY+height; ++y){
-                auto &p = this->pixels[x + y * this->width];
-                if(p.a != 0){
+                if(this->get(x, y).a != 0){
                     return false;
                 }
             }
@@ -398,68 +533,47 @@ std::vector<std::vector<DNK::Rect<unsigned>>> DNK::Bitmap::findBoxes(){
 
 
 bool DNK::Bitmap::load(int w, int h, int chan, unsigned char* src){
+    if(chan != 3 && chan != 4){
+        fprintf(stderr, "Bitmap::load: Only RGB and RGBA pixels can be loaded, got %i channels\n", chan);
+        return false;
+    }
     this->width = w;
     this->height = h;
-    
     this->format = chan == 4 ? ImageFormat::RGBA : ImageFormat::RGB;
     this->channels = chan;
-    this->pixels.resize(width * height);
-    
-    for(unsigned i = 0; i < width * height; ++i){
-        auto &pixel = this->pixels[i];
-        pixel.r = src[i * 4 + 0] / 255.0f;
-        pixel.g = src[i * 4 + 1] / 255.0f;
-        pixel.b = src[i * 4 + 2] / 255.0f;
-        pixel.a = src[i * 4 + 3] / 255.0f;
-    }
-    
+    this->pixels.assign(src, src + width * height * chan);
     return true;
 }
 
 bool DNK::Bitmap::load(const std::string &path){
     int width, height, chan;
     
-    unsigned char *data = stbi_load(path.c_str(), &width, &height, &chan, 0); 
-    
+    // the header says how many channels there are, so the image decodes once
+    if(!stbi_info(path.c_str(), &width, &height, &chan)){
+        return false;
+    }
+    // grey comes in as RGB, grey and alpha as RGBA
+    auto wanted = chan == 4 || chan == 2 ? 4 : 3;
+    unsigned char *data = stbi_load(path.c_str(), &width, &height, &chan, wanted);
     if(!data){
         return false;
-    }		
-    
-    this->width = width;
-    this->height = height;
-    
-    this->format = chan == 4 ? ImageFormat::RGBA : ImageFormat::RGB;
-    this->channels = chan;
-    this->pixels.resize(width * height);
-    
-    unsigned total = width * height * chan;
-    for(unsigned i = 0; i < width * height; ++i){
-        auto &pixel = this->pixels[i];
-        pixel.r = data[i * 4 + 0] / 255.0f;
-        pixel.g = data[i * 4 + 1] / 255.0f;
-        pixel.b = data[i * 4 + 2] / 255.0f;
-        pixel.a = data[i * 4 + 3] / 255.0f;
     }
-    
+    auto ok = this->load(width, height, wanted, data);
     stbi_image_free(data);
     
-    return true;
+    return ok;
 }
 
 bool DNK::Bitmap::write(const std::string &path){
-    unsigned char *data = new unsigned char[width * height * this->channels];
-
-    for(unsigned i = 0; i < this->width * this->height; ++i){
-        auto &pixel = this->pixels[i];
-        data[i * 4 + 0] = pixel.r * 255.0f;
-        data[i * 4 + 1] = pixel.g * 255.0f;
-        data[i * 4 + 2] = pixel.b * 255.0f;
-        data[i * 4 + 3] = pixel.a * 255.0f;
-    }	
-
-    stbi_write_png(path.c_str(), this->width, this->height, 4, data, this->width * this->channels);
-    
-    delete data;
-    
-    return true;
-}
\ No newline at end of file
+    // RG has no PNG equivalent, it goes out as RGB
+    if(this->format == ImageFormat::RG){
+        DNK::Bitmap rgb;
+        rgb.build(DNK::Colors::Black, ImageFormat::RGB, this->width, this->height);
+        for(size_t i = 0; i < this->width * this->height; ++i){
+            rgb.pixels[i * 3 + 0] = this->pixels[i * 2 + 0];
+            rgb.pixels[i * 3 + 1] = this->pixels[i * 2 + 1];
+        }
+        return rgb.write(path);
+    }
+    return stbi_write_png(path.c_str(), this->width, this->height, this->channels, this->pixels.data(), this->width * this->channels) != 0;
+}
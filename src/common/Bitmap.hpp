@@ -14,13 +14,15 @@
                 RG, // 16 bit
                 RGB, // 24 bits
                 RGBA, // 32 bits
+                A, // 8 bits, coverage
             };
             static unsigned getChannels(unsigned format){
                 switch(format){
                     default:
                     case ImageFormat::RED:
                     case ImageFormat::GREEN:
-                    case ImageFormat::BLUE: {
+                    case ImageFormat::BLUE:
+                    case ImageFormat::A: {
                         return 1;
                     }; 
                     case ImageFormat::RG: {
@@ -36,19 +38,52 @@
             }
         }     
 
+        // Pixels are kept packed in the bitmap's format, a byte per channel, rows
+        // top to bottom. DNK::Color is only what goes in and out of get(), set()
+        // and the drawing calls, every op runs on the bytes of its format
         struct Bitmap {
-            std::vector<DNK::Color> pixels;
+            std::vector<uint8> pixels; // width * height * channels
             unsigned width;
             unsigned height;
             unsigned format;
             unsigned channels;
-            
+
+            Bitmap(){
+                width = 0;
+                height = 0;
+                format = DNK::ImageFormat::RGBA;
+                channels = 4;
+            }
+
+            // channels missing from the format read as 0, alpha as 1
+            DNK::Color get(unsigned x, unsigned y) const;
+            void set(unsigned x, unsigned y, const DNK::Color &c);
+
+            // (x, y, w, h) cut to the bitmap, w or h is 0 when nothing is left.
+            // Every op clips once with this and then works a row span at a time
+            DNK::Rect<unsigned> clip(int x, int y, int w, int h) const;
+
+            // Spans are n pixels of row y from x on, already clipped. The format
+            // is picked once per span and RGBA spans go through the Blit kernels
+            void fillSpan(unsigned x, unsigned y, unsigned n, const DNK::Color &c);
+            // src holds n pixels in this bitmap's format
+            void copySpan(unsigned x, unsigned y, unsigned n, const uint8 *src);
+            // src over the span, its colour channels multiplied by tint first
+            void blendSpan(unsigned x, unsigned y, unsigned n, const uint8 *src, const DNK::Color &tint);
+            // c through n coverage bytes
+            void coverageSpan(unsigned x, unsigned y, unsigned n, const uint8 *coverage, const DNK::Color &c);
+
             Bitmap sub(const DNK::Rect<unsigned> &box);
             Bitmap sub(unsigned x, unsigned y, unsigned width, unsigned height);
             Bitmap rotate(float angle);
 
             void paste(Bitmap *src, unsigned x, unsigned y, bool alphaBlend);
             void pasteAndShade(Bitmap *src, unsigned x, unsigned y, const DNK::Color &c);
+            // blends c through an 8-bit coverage mask (w x h, rows `pitch` bytes apart)
+            void pasteMask(const uint8 *mask, unsigned pitch, unsigned w, unsigned h, int x, int y, const DNK::Color &c);
+            // blends c through a distance field (128 on the edge, `spread` field pixels
+            // per 128 steps) drawn `scale` times its size with its corner at x, y
+            void pasteField(const uint8 *field, unsigned pitch, unsigned w, unsigned h, float x, float y, float scale, float spread, const DNK::Color &c);
 
             void resize(unsigned nwidth, unsigned nheight);
             void shade(const DNK::Color &color);
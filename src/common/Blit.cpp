@@ -0,0 +1,226 @@
+#include <string.h>
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__SSE2__)) && !defined(DNK_NO_SIMD)
+    #include <immintrin.h>
+    #define DNK_BLIT_X86
+#endif
+
+#include "Blit.hpp"
+
+namespace Blit {
+
+    // Same operations in the same order as BitmapFormat::blendChannel and
+    // toByte, no FMA, so every lane rounds exactly like the scalar code
+    static inline uint8 blendScalar(float src, float a, uint8 d){
+        float v = (src * a) + ((d / 255.0f) * (1.0f - a));
+        return static_cast<uint8>(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+    }
+
+    static void overScalar(uint8 *dst, const uint8 *src, unsigned n, const float *tint){
+        for(unsigned i = 0; i < n; ++i, dst += 4, src += 4){
+            float a = src[3] / 255.0f;
+            for(unsigned c = 0; c < 3; ++c){
+                dst[c] = blendScalar((src[c] / 255.0f) * tint[c], a, dst[c]);
+            }
+            dst[3] = 255;
+        }
+    }
+
+    static void coverageScalar(uint8 *dst, const uint8 *coverage, unsigned n, const float *color){
+        for(unsigned i = 0; i < n; ++i, dst += 4){
+            float a = coverage[i] / 255.0f;
+            for(unsigned c = 0; c < 3; ++c){
+                dst[c] = blendScalar(a * color[c], a, dst[c]);
+            }
+            dst[3] = 255;
+        }
+    }
+
+    #ifdef DNK_BLIT_X86
+
+        // Four pixels as epi32 lanes (R in the low byte), one channel per register
+        struct Pixels4 {
+            __m128 r, g, b, a;
+        };
+
+        static inline Pixels4 unpackSSE2(__m128i p){
+            const auto byte = _mm_set1_epi32(0xFF);
+            const auto scale = _mm_set1_ps(255.0f);
+            Pixels4 out;
+            out.r = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(p, byte)), scale);
+            out.g = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), byte)), scale);
+            out.b = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), byte)), scale);
+            out.a = _mm_div_ps(_mm_cvtepi32_ps(_mm_srli_epi32(p, 24)), scale);
+            return out;
+        }
+
+        static inline __m128i toBytesSSE2(__m128 src, __m128 a, __m128 ia, __m128 d){
+            auto v = _mm_add_ps(_mm_mul_ps(src, a), _mm_mul_ps(d, ia));
+            v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+            return _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+        }
+
+        static inline __m128i blendSSE2(const Pixels4 &d, __m128 r, __m128 g, __m128 b, __m128 a){
+            auto ia = _mm_sub_ps(_mm_set1_ps(1.0f), a);
+            auto out = _mm_or_si128(toBytesSSE2(r, a, ia, d.r), _mm_slli_epi32(toBytesSSE2(g, a, ia, d.g), 8));
+            out = _mm_or_si128(out, _mm_slli_epi32(toBytesSSE2(b, a, ia, d.b), 16));
+            return _mm_or_si128(out, _mm_set1_epi32(0xFF000000));
+        }
+
+        static void overSSE2(uint8 *dst, const uint8 *src, unsigned n, const float *tint){
+            const auto tr = _mm_set1_ps(tint[0]);
+            const auto tg = _mm_set1_ps(tint[1]);
+            const auto tb = _mm_set1_ps(tint[2]);
+            const auto alpha = _mm_set1_epi32(0xFF000000);
+            unsigned i = 0;
+            for(; i + 4 <= n; i += 4){
+                auto to = reinterpret_cast<__m128i*>(dst + i * 4);
+                auto sp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+                auto dp = _mm_loadu_si128(to);
+                // nothing to draw, a blend would only make the target opaque
+                if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(sp, alpha), _mm_setzero_si128())) == 0xFFFF){
+                    _mm_storeu_si128(to, _mm_or_si128(dp, alpha));
+                    continue;
+                }
+                auto s = unpackSSE2(sp);
+                auto d = unpackSSE2(dp);
+                _mm_storeu_si128(to, blendSSE2(d, _mm_mul_ps(s.r, tr), _mm_mul_ps(s.g, tg), _mm_mul_ps(s.b, tb), s.a));
+            }
+            overScalar(dst + i * 4, src + i * 4, n - i, tint);
+        }
+
+        static void coverageSSE2(uint8 *dst, const uint8 *coverage, unsigned n, const float *color){
+            const auto cr = _mm_set1_ps(color[0]);
+            const auto cg = _mm_set1_ps(color[1]);
+            const auto cb = _mm_set1_ps(color[2]);
+            const auto zero = _mm_setzero_si128();
+            unsigned i = 0;
+            for(; i + 4 <= n; i += 4){
+                auto to = reinterpret_cast<__m128i*>(dst + i * 4);
+                auto dp = _mm_loadu_si128(to);
+                uint32 m;
+                memcpy(&m, coverage + i, sizeof(m));
+                if(m == 0){
+                    _mm_storeu_si128(to, _mm_or_si128(dp, _mm_set1_epi32(0xFF000000)));
+                    continue;
+                }
+                auto wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(m), zero), zero);
+                auto a = _mm_div_ps(_mm_cvtepi32_ps(wide), _mm_set1_ps(255.0f));
+                auto d = unpackSSE2(dp);
+                _mm_storeu_si128(to, blendSSE2(d, _mm_mul_ps(a, cr), _mm_mul_ps(a, cg), _mm_mul_ps(a, cb), a));
+            }
+            coverageScalar(dst + i * 4, coverage + i, n - i, color);
+        }
+
+        struct Pixels8 {
+            __m256 r, g, b, a;
+        };
+
+        __attribute__((target("avx2")))
+        static inline Pixels8 unpackAVX2(__m256i p){
+            const auto byte = _mm256_set1_epi32(0xFF);
+            const auto scale = _mm256_set1_ps(255.0f);
+            Pixels8 out;
+            out.r = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(p, byte)), scale);
+            out.g = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 8), byte)), scale);
+            out.b = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 16), byte)), scale);
+            out.a = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(p, 24)), scale);
+            return out;
+        }
+
+        __attribute__((target("avx2")))
+        static inline __m256i toBytesAVX2(__m256 src, __m256 a, __m256 ia, __m256 d){
+            auto v = _mm256_add_ps(_mm256_mul_ps(src, a), _mm256_mul_ps(d, ia));
+            v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+            return _mm256_cvttps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(255.0f)));
+        }
+
+        __attribute__((target("avx2")))
+        static inline __m256i blendAVX2(const Pixels8 &d, __m256 r, __m256 g, __m256 b, __m256 a){
+            auto ia = _mm256_sub_ps(_mm256_set1_ps(1.0f), a);
+            auto out = _mm256_or_si256(toBytesAVX2(r, a, ia, d.r), _mm256_slli_epi32(toBytesAVX2(g, a, ia, d.g), 8));
+            out = _mm256_or_si256(out, _mm256_slli_epi32(toBytesAVX2(b, a, ia, d.b), 16));
+            return _mm256_or_si256(out, _mm256_set1_epi32(0xFF000000));
+        }
+
+        __attribute__((target("avx2")))
+        static void overAVX2(uint8 *dst, const uint8 *src, unsigned n, const float *tint){
+            const auto tr = _mm256_set1_ps(tint[0]);
+            const auto tg = _mm256_set1_ps(tint[1]);
+            const auto tb = _mm256_set1_ps(tint[2]);
+            const auto alpha = _mm256_set1_epi32(0xFF000000);
+            unsigned i = 0;
+            for(; i + 8 <= n; i += 8){
+                auto to = reinterpret_cast<__m256i*>(dst + i * 4);
+                auto sp = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+                auto dp = _mm256_loadu_si256(to);
+                if(_mm256_testz_si256(sp, alpha)){
+                    _mm256_storeu_si256(to, _mm256_or_si256(dp, alpha));
+                    continue;
+                }
+                auto s = unpackAVX2(sp);
+                auto d = unpackAVX2(dp);
+                _mm256_storeu_si256(to, blendAVX2(d, _mm256_mul_ps(s.r, tr), _mm256_mul_ps(s.g, tg), _mm256_mul_ps(s.b, tb), s.a));
+            }
+            overSSE2(dst + i * 4, src + i * 4, n - i, tint);
+        }
+
+        __attribute__((target("avx2")))
+        static void coverageAVX2(uint8 *dst, const uint8 *coverage, unsigned n, const float *color){
+            const auto cr = _mm256_set1_ps(color[0]);
+            const auto cg = _mm256_set1_ps(color[1]);
+            const auto cb = _mm256_set1_ps(color[2]);
+            unsigned i = 0;
+            for(; i + 8 <= n; i += 8){
+                auto to = reinterpret_cast<__m256i*>(dst + i * 4);
+                auto dp = _mm256_loadu_si256(to);
+                uint64 m;
+                memcpy(&m, coverage + i, sizeof(m));
+                if(m == 0){
+                    _mm256_storeu_si256(to, _mm256_or_si256(dp, _mm256_set1_epi32(0xFF000000)));
+                    continue;
+                }
+                auto wide = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(static_cast<long long>(m)));
+                auto a = _mm256_div_ps(_mm256_cvtepi32_ps(wide), _mm256_set1_ps(255.0f));
+                auto d = unpackAVX2(dp);
+                _mm256_storeu_si256(to, blendAVX2(d, _mm256_mul_ps(a, cr), _mm256_mul_ps(a, cg), _mm256_mul_ps(a, cb), a));
+            }
+            coverageSSE2(dst + i * 4, coverage + i, n - i, color);
+        }
+
+    #endif
+
+    std::vector<Blit::Kernels> rowKernels(){
+        std::vector<Blit::Kernels> kernels;
+        kernels.push_back(Blit::Kernels { "scalar", overScalar, coverageScalar });
+        #ifdef DNK_BLIT_X86
+            kernels.push_back(Blit::Kernels { "sse2", overSSE2, coverageSSE2 });
+            if(__builtin_cpu_supports("avx2")){
+                kernels.push_back(Blit::Kernels { "avx2", overAVX2, coverageAVX2 });
+            }
+        #endif
+        return kernels;
+    }
+
+    static const Blit::Kernels &kernels(){
+        static const Blit::Kernels k = Blit::rowKernels().back();
+        return k;
+    }
+
+    void copyRow(uint8 *dst, const uint8 *src, unsigned n){
+        // libc's memcpy is already vectorized and dispatched per CPU
+        memcpy(dst, src, n * 4);
+    }
+
+    void overRow(uint8 *dst, const uint8 *src, unsigned n, const DNK::Color &tint){
+        const float t[3] = { tint.r, tint.g, tint.b };
+        kernels().over(dst, src, n, t);
+    }
+
+    void coverageRow(uint8 *dst, const uint8 *coverage, unsigned n, const DNK::Color &color){
+        const float c[3] = { color.r, color.g, color.b };
+        kernels().coverage(dst, coverage, n, c);
+    }
+
+}
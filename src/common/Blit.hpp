@@ -0,0 +1,39 @@
+#ifndef DNK_BLIT_HPP
+    #define DNK_BLIT_HPP
+
+    #include <vector>
+    #include "./Types.hpp"
+
+    // Row kernels for RGBA8 pixels (SSE2/AVX2 when available, picked once at
+    // runtime). Callers clip the rect once and hand over one row at a time.
+    // Like Bitmap, the destination is treated as opaque: colour channels come
+    // out as src * a + dst * (1 - a) and alpha as 255, byte for byte what the
+    // per-pixel path in Bitmap.cpp produces
+    namespace Blit {
+
+        // n pixels, verbatim
+        void copyRow(uint8 *dst, const uint8 *src, unsigned n);
+
+        // source-over of n pixels, colour channels multiplied by tint first
+        void overRow(uint8 *dst, const uint8 *src, unsigned n, const DNK::Color &tint);
+
+        // n coverage bytes of `color`, as glyph masks are drawn
+        void coverageRow(uint8 *dst, const uint8 *coverage, unsigned n, const DNK::Color &color);
+
+        // The row kernels behind overRow and coverageRow, tint and color as r, g, b
+        typedef void (*OverKernel)(uint8 *dst, const uint8 *src, unsigned n, const float *tint);
+        typedef void (*CoverageKernel)(uint8 *dst, const uint8 *coverage, unsigned n, const float *color);
+
+        struct Kernels {
+            const char *name;
+            Blit::OverKernel over;
+            Blit::CoverageKernel coverage;
+        };
+
+        // Every kernel pair this build and CPU can run, scalar first. The rows
+        // above take the last one, the others are there to be checked against it
+        std::vector<Blit::Kernels> rowKernels();
+
+    }
+
+#endif
@@ -7,6 +7,9 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -16,6 +19,7 @@
 #include <cmath>
 #include <mutex>
 #include <fstream>
+#include <cstring>
 
 #include "Tools.hpp"
 
@@ -90,16 +94,74 @@ namespace DNK {
 		
 		static int useDirSep = Core::PLATFORM;
 
+		bool View::open(const std::string &path){
+			close();
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if(fd < 0){
+				fprintf(stderr, "File::View::open: Failed to open '%s': %s\n", path.c_str(), strerror(errno));
+				return false;
+			}
+			struct stat st;
+			if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+				auto addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if(addr != MAP_FAILED){
+					madvise(addr, st.st_size, MADV_SEQUENTIAL);
+					::close(fd);
+					this->data = static_cast<const char*>(addr);
+					this->size = st.st_size;
+					this->mapped = true;
+					return true;
+				}
+			}
+			// pipes, special files or a failed mmap: plain reads into the owned buffer
+			char chunk[64 * 1024];
+			while(true){
+				auto n = ::read(fd, chunk, sizeof(chunk));
+				if(n < 0){
+					if(errno == EINTR){
+						continue;
+					}
+					fprintf(stderr, "File::View::open: Failed to read '%s': %s\n", path.c_str(), strerror(errno));
+					::close(fd);
+					this->buffer.clear();
+					return false;
+				}
+				if(n == 0){
+					break;
+				}
+				this->buffer.append(chunk, n);
+			}
+			::close(fd);
+			this->data = this->buffer.data();
+			this->size = this->buffer.size();
+			return true;
+		}
+
+		void View::close(){
+			if(this->mapped){
+				munmap(const_cast<char*>(this->data), this->size);
+			}
+			this->buffer.clear();
+			this->data = NULL;
+			this->size = 0;
+			this->mapped = false;
+		}
+
+		std::shared_ptr<DNK::File::View> map(const std::string &path){
+			auto view = std::make_shared<DNK::File::View>();
+			if(!view->open(path)){
+				return std::shared_ptr<DNK::File::View>();
+			}
+			return view;
+		}
+
 		std::string readTextFile(const std::string &path){
 			std::ifstream file(path, std::ios::binary);
 			file.seekg(0, std::ios::end);
 			size_t size = file.tellg();
-			char *buffer = new char[size];
-			memset(buffer, 0, size);
 			file.seekg(0);
-			file.read(buffer, size); 
-			std::string text(buffer, size);
-			delete buffer;
+			std::string text(size, '\0');
+			file.read(&text[0], size);
 			return text;
 		}
 
@@ -161,6 +223,36 @@ namespace DNK {
 	}
 }
 
+/*
+	HASH
+*/
+static uint64 mix64(uint64 h){
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+uint64 DNK::Hash::bytes(const char *data, size_t size){
+	// 8 bytes per step, murmur3 finalizer. Only as strong as a cache key needs
+	const uint64 k = 0x9e3779b97f4a7c15ULL;
+	uint64 h = size * k;
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8){
+		uint64 w;
+		memcpy(&w, data + i, 8);
+		h = (h ^ mix64(w)) * k;
+	}
+	uint64 w = 0;
+	if(i < size){
+		memcpy(&w, data + i, size - i);
+	}
+	h = (h ^ mix64(w ^ (size - i))) * k;
+	return mix64(h);
+}
+
 /*
 	STRING
 */
@@ -277,6 +369,44 @@ bool DNK::String::isString(const std::string &s){
     return s.size() > 1 && s[0] == '\'' && s[s.length()-1] == '\'';
 }
 
+uint32 DNK::String::decodeUTF8(const std::string &str, size_t &i){
+    auto c = static_cast<unsigned char>(str[i++]);
+    if(c < 0x80){
+        return c;
+    }
+    unsigned extra = 0;
+    uint32 codepoint = 0;
+    uint32 min = 0;
+    if((c & 0xE0) == 0xC0){
+        extra = 1;
+        codepoint = c & 0x1F;
+        min = 0x80;
+    }else
+    if((c & 0xF0) == 0xE0){
+        extra = 2;
+        codepoint = c & 0x0F;
+        min = 0x800;
+    }else
+    if((c & 0xF8) == 0xF0){
+        extra = 3;
+        codepoint = c & 0x07;
+        min = 0x10000;
+    }else{
+        return 0xFFFD;
+    }
+    for(unsigned k = 0; k < extra; ++k){
+        if(i >= str.size() || (static_cast<unsigned char>(str[i]) & 0xC0) != 0x80){
+            return 0xFFFD;
+        }
+        codepoint = (codepoint << 6) | (static_cast<unsigned char>(str[i++]) & 0x3F);
+    }
+    // overlong forms, surrogates and anything past U+10FFFF
+    if(codepoint < min || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)){
+        return 0xFFFD;
+    }
+    return codepoint;
+}
+
 std::string DNK::String::replaceAll(std::string subject, const std::string& search, const std::string& replace){
     size_t pos = 0;
     while ((pos = subject.find(search, pos)) != std::string::npos) {
@@ -1,6 +1,7 @@
 #ifndef DNK_TOOLS_HPP
     #define DNK_TOOLS_HPP
 
+    #include <string_view>
     #include "Types.hpp"
     #include "thirdparty/Jzon.hpp"
 
@@ -116,6 +117,8 @@
         namespace Hash {
             std::string md5(const std::string &path, bool partial = false);
             std::string md5(char *data, size_t size, bool partial = false);
+            // fast non-cryptographic 64-bit hash, used to key caches on content
+            uint64 bytes(const char *data, size_t size);
         }
         
         namespace File {
@@ -126,7 +129,34 @@
                     Any
                 }; 
             }
+            // Whole file, read-only. Mapped with mmap when the file allows it,
+            // otherwise read once into an owned buffer
+            struct View {
+                const char *data;
+                size_t size;
+                bool mapped;
+                std::string buffer;
+
+                View(){
+                    data = NULL;
+                    size = 0;
+                    mapped = false;
+                }
+                View(const View &other) = delete;
+                View &operator=(const View &other) = delete;
+                ~View(){
+                    close();
+                }
+
+                bool open(const std::string &path);
+                void close();
+                std::string_view str() const {
+                    return std::string_view(data, size);
+                }
+            };
+
             std::string getCwd();
+            std::shared_ptr<DNK::File::View> map(const std::string &path);
             std::string readTextFile(const std::string &path);
             void setDirStep(int platform);
             std::string dirSep();
@@ -160,6 +190,8 @@
             std::string replaceAll(std::string subject, const std::string &search, const std::string &replace);
             bool isNumber(const std::string &s);
             bool isString(const std::string &s);             
+            // codepoint at str[i], moving i past it. Malformed bytes give U+FFFD
+            uint32 decodeUTF8(const std::string &str, size_t &i);
 
             template<typename T>
             std::string str(const DNK::Vec2<T> &vec){
@@ -25,6 +25,7 @@ THE SOFTWARE.
 #include <string>
 #include <vector>
 #include <queue>
+#include <cstddef>
 #include <iterator>
 #include <istream>
 #include <ostream>
@@ -63,9 +64,16 @@ namespace Jzon
 	class JZON_API Node
 	{
 	public:
-		class iterator : public std::iterator<std::input_iterator_tag, NamedNode>
+		class iterator
 		{
 		public:
+			// spelled out, std::iterator is deprecated in C++17
+			typedef std::input_iterator_tag iterator_category;
+			typedef NamedNode value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef NamedNode *pointer;
+			typedef NamedNode &reference;
+
             iterator() : p(0) {}
 			iterator(NamedNode *o) : p(o) {}
 			iterator(const iterator &it) : p(it.p) {}
@@ -82,9 +90,16 @@ namespace Jzon
 		private:
 			NamedNode *p;
 		};
-		class const_iterator : public std::iterator<std::input_iterator_tag, const NamedNode>
+		class const_iterator
 		{
 		public:
+			// spelled out, std::iterator is deprecated in C++17
+			typedef std::input_iterator_tag iterator_category;
+			typedef const NamedNode value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const NamedNode *pointer;
+			typedef const NamedNode &reference;
+
 			const_iterator() : p(0) {}
 			const_iterator(const NamedNode *o) : p(o) {}
 			const_iterator(const const_iterator &it) : p(it.p) {}
@@ -2,6 +2,8 @@
     #define DNK_DINKY_HPP
 
     #include <unordered_map>
+    #include <string_view>
+    #include <functional>
     #include "common/Types.hpp"
     #include "common/Tools.hpp"
 
@@ -71,37 +73,223 @@
             }
         }
 
-        struct Node {
-            unsigned type;
-            std::unordered_map<std::string, std::string> styling;
-            std::string str;
-            std::unordered_map<std::string, std::string> params;
-            std::vector<std::shared_ptr<DNK::Node>> children;
+        // Keys of styles (!key=value) and media params (key:value). The ones the
+        // renderer knows are fixed, the rest get interned per document from CUSTOM on
+        namespace AttributeKey {
+            enum AttributeKey : unsigned {
+                MARGIN,
+                SPACING,
+                LINE_HEIGHT,
+                COLOR,
+                BOLD,
+                VALUE,
+                SOURCE,
+                WIDTH,
+                HEIGHT,
+                CUSTOM
+            };
 
-            Node(){
+            static int key(std::string_view name){
+                if(name == "m"){
+                    return AttributeKey::MARGIN;
+                }else
+                if(name == "s"){
+                    return AttributeKey::SPACING;
+                }else
+                if(name == "ln"){
+                    return AttributeKey::LINE_HEIGHT;
+                }else
+                if(name == "color"){
+                    return AttributeKey::COLOR;
+                }else
+                if(name == "bold"){
+                    return AttributeKey::BOLD;
+                }else
+                if(name == "v"){
+                    return AttributeKey::VALUE;
+                }else
+                if(name == "src"){
+                    return AttributeKey::SOURCE;
+                }else
+                if(name == "w"){
+                    return AttributeKey::WIDTH;
+                }else
+                if(name == "h"){
+                    return AttributeKey::HEIGHT;
+                }else{
+                    return -1;
+                }
             }
 
-            float getNumberStyle(const std::string &name){
-                if(styling.count(name) == 0 || !DNK::String::isNumber(styling[name])){
-                    return 0.0f;
+            static std::string name(unsigned key){
+                switch(key){
+                    case AttributeKey::MARGIN: {
+                        return "m";
+                    };
+                    case AttributeKey::SPACING: {
+                        return "s";
+                    };
+                    case AttributeKey::LINE_HEIGHT: {
+                        return "ln";
+                    };
+                    case AttributeKey::COLOR: {
+                        return "color";
+                    };
+                    case AttributeKey::BOLD: {
+                        return "bold";
+                    };
+                    case AttributeKey::VALUE: {
+                        return "v";
+                    };
+                    case AttributeKey::SOURCE: {
+                        return "src";
+                    };
+                    case AttributeKey::WIDTH: {
+                        return "w";
+                    };
+                    case AttributeKey::HEIGHT: {
+                        return "h";
+                    };
+                    default: {
+                        return "";
+                    };
                 }
-                return DNK::String::number(styling[name]);
             }
+        }
+
+        namespace ValueType {
+            enum ValueType : uint8 {
+                STRING,
+                NUMBER,
+                LENGTH,
+                COLOR,
+                BOOL
+            };
+        }
+
+        namespace Unit {
+            enum Unit : uint8 {
+                NONE,
+                REM,
+                PERCENT,
+                PIXEL
+            };
+        }
+
+        // [offset, offset+length) into the document's source buffer
+        struct Span {
+            uint32 offset;
+            uint32 length;
+        };
 
-            bool getBoolStyle(const std::string &name){
-                if(styling.count(name) == 0){
-                    return false;
+        // Resolved once at parse time
+        struct Value {
+            uint8 type;
+            uint8 unit;
+            union {
+                float number;
+                uint32 color; // 0xRRGGBBAA
+                bool flag;
+            };
+            DNK::Span str; // as written, without quotes
+
+            float rem() const {
+                if(type == DNK::ValueType::NUMBER || (type == DNK::ValueType::LENGTH && unit == DNK::Unit::REM)){
+                    return number;
                 }
-                return DNK::String::lower(styling[name]) == "true";
+                return 0.0f;
             }
 
-            std::string getStringStyle(const std::string &name){
-                if(styling.count(name) == 0){
-                    return "";
-                }
-                return styling[name];
+            DNK::Color getColor() const {
+                return DNK::Color(
+                    ((color >> 24) & 0xFF) / 255.0f,
+                    ((color >> 16) & 0xFF) / 255.0f,
+                    ((color >> 8) & 0xFF) / 255.0f,
+                    (color & 0xFF) / 255.0f
+                );
+            }
+        };
+
+        struct Attribute {
+            uint32 key;
+            DNK::Value value;
+        };
+
+        // Nodes are linked by index into Arena::nodes. Text, styles and params of a
+        // node are contiguous ranges in the arena arrays
+        struct Node {
+            static const uint32 NONE = 0xFFFFFFFF;
+
+            unsigned type;
+            uint32 parent;
+            uint32 firstChild;
+            uint32 nextSibling;
+            // source range from '[' to just past ']' (the whole text for the root)
+            uint32 start;
+            uint32 end;
+            uint32 firstRun;
+            uint32 runCount;
+            uint32 firstStyle;
+            uint32 styleCount;
+            uint32 firstParam;
+            uint32 paramCount;
+            // !m, !s and !ln pre-resolved for the renderer (rem)
+            float margin;
+            float spacing;
+            float lineHeight;
+
+            Node(){
+                type = DNK::NodeType::PANEL;
+                parent = NONE;
+                firstChild = NONE;
+                nextSibling = NONE;
+                start = 0;
+                end = 0;
+                firstRun = 0;
+                runCount = 0;
+                firstStyle = 0;
+                styleCount = 0;
+                firstParam = 0;
+                paramCount = 0;
+                margin = 0.0f;
+                spacing = 0.0f;
+                lineHeight = 0.0f;
+            }
+        };
+
+        // Owns the whole tree of a document. Everything is released at once with it
+        struct Arena {
+            std::string source;
+            // when set, spans point into `external` instead of source. `input` keeps
+            // the bytes alive when they belong to a file, else the owner outlives the arena
+            std::shared_ptr<DNK::File::View> input;
+            std::string_view external;
+            std::vector<DNK::Node> nodes;
+            std::vector<DNK::Span> runs;
+            std::vector<DNK::Attribute> styles;
+            std::vector<DNK::Attribute> params;
+            std::vector<DNK::Span> keys; // names of AttributeKey::CUSTOM + i
+            uint32 dead; // nodes left unreachable by DNK::reparse
+
+            Arena(){
+                dead = 0;
             }
 
+            std::string_view text() const {
+                return external.data() != NULL ? external : std::string_view(source);
+            }
+
+            void clear(){
+                source.clear();
+                input.reset();
+                external = std::string_view();
+                nodes.clear();
+                runs.clear();
+                styles.clear();
+                params.clear();
+                keys.clear();
+                dead = 0;
+            }
         };
 
         struct Settings {
@@ -119,22 +307,183 @@
             }
         };
 
+        // Limits for untrusted input. Parsing fails as soon as one is crossed
+        struct ParseOptions {
+            size_t maxSize;     // bytes of source
+            unsigned maxDepth;  // levels of nested brackets
+            size_t maxNodes;
+            unsigned threads;   // > 1 parses top-level blocks in parallel, same tree as serial
+            ParseOptions(){
+                maxSize = DNK::Node::NONE - 1;
+                maxDepth = 256;
+                maxNodes = DNK::Node::NONE - 1;
+                threads = 1;
+            }
+        };
+
         struct Document {
             std::string title;
             std::string author;
             unsigned type;
             uint64 createdAt;
             uint64 modifiedAt;
-            std::shared_ptr<DNK::Node> body;
+            uint32 body;
             DNK::Settings settings;
+            DNK::Arena arena;
+
+            Document(){
+                body = DNK::Node::NONE;
+            }
+
+            std::string_view getSpan(const DNK::Span &span) const {
+                return std::string_view(arena.text().data() + span.offset, span.length);
+            }
+
+            uint32 findKey(std::string_view name) const {
+                auto known = DNK::AttributeKey::key(name);
+                if(known != -1){
+                    return known;
+                }
+                for(uint32 i = 0; i < arena.keys.size(); ++i){
+                    if(getSpan(arena.keys[i]) == name){
+                        return DNK::AttributeKey::CUSTOM + i;
+                    }
+                }
+                return DNK::Node::NONE;
+            }
+
+            std::string getKeyName(uint32 key) const {
+                if(key < DNK::AttributeKey::CUSTOM){
+                    return DNK::AttributeKey::name(key);
+                }
+                return std::string(getSpan(arena.keys[key - DNK::AttributeKey::CUSTOM]));
+            }
+
+            const DNK::Value *findAttribute(const std::vector<DNK::Attribute> &list, uint32 first, uint32 count, uint32 key) const {
+                // the last one wins, same as assigning them in order
+                for(uint32 i = count; i > 0; --i){
+                    auto &attr = list[first + i - 1];
+                    if(attr.key == key){
+                        return &attr.value;
+                    }
+                }
+                return NULL;
+            }
+
+            const DNK::Value *getStyle(uint32 node, uint32 key) const {
+                auto &n = arena.nodes[node];
+                return findAttribute(arena.styles, n.firstStyle, n.styleCount, key);
+            }
+
+            const DNK::Value *getParam(uint32 node, uint32 key) const {
+                auto &n = arena.nodes[node];
+                return findAttribute(arena.params, n.firstParam, n.paramCount, key);
+            }
+
+            float getNumberStyle(uint32 node, uint32 key) const {
+                auto style = getStyle(node, key);
+                return style == NULL ? 0.0f : style->rem();
+            }
+
+            bool getBoolStyle(uint32 node, uint32 key) const {
+                auto style = getStyle(node, key);
+                return style != NULL && style->type == DNK::ValueType::BOOL && style->flag;
+            }
+
+            std::string getStringStyle(uint32 node, uint32 key) const {
+                auto style = getStyle(node, key);
+                return style == NULL ? "" : std::string(getSpan(style->str));
+            }
+
+            std::string getStringParam(uint32 node, uint32 key) const {
+                auto param = getParam(node, key);
+                return param == NULL ? "" : std::string(getSpan(param->str));
+            }
+
+            std::string getText(uint32 node) const;
+        };
+
+        // Push parser for input that arrives in chunks. Every block directly under the
+        // root is handed to onBlock as soon as its closing ']' arrives, parsed into a
+        // document of its own whose body has that block as only child. Only the block
+        // being received is buffered, but it is buffered whole, however big. Whatever
+        // sits between blocks belongs to the root and is parsed by finish(). A
+        // consumer that keeps nothing of a block runs in memory bounded by the
+        // biggest top-level block plus the root text. The block document only views
+        // its source, which is gone once onBlock returns
+        struct StreamParser {
+            DNK::ParseOptions options;
+            std::function<bool(const DNK::Document &block)> onBlock;
+            // when set, blocks are received at the end of it instead of a buffer of
+            // their own and left there, for a consumer that keeps the whole source
+            std::string *sink;
+
+            StreamParser(const DNK::ParseOptions &options = DNK::ParseOptions());
+            bool push(const char *data, size_t size);
+            bool read(int fd);
+            bool finish(DNK::Document &root);
+
+            // scanner state, carried over between chunks
+            std::string pending;
+            std::string rootSrc;
+            std::shared_ptr<DNK::Document> block;
+            size_t total;
+            size_t blockStart;
+            size_t blockBegin;
+            unsigned depth;
+            bool inMedia;
+            bool inQuote;
+            bool inStyle;
+            bool emit();
         };
 
         // Parse/Read
         std::shared_ptr<DNK::Document> build(const std::string &title, const std::string &author, unsigned type);
-        bool parse(const std::shared_ptr<DNK::Document> &target, const std::string &src);
+        bool parse(const std::shared_ptr<DNK::Document> &target, const std::string &src, const DNK::ParseOptions &options = DNK::ParseOptions());
+        // parses straight out of the (usually mapped) file, the document keeps it open
+        bool parse(const std::shared_ptr<DNK::Document> &target, const std::shared_ptr<DNK::File::View> &input, const DNK::ParseOptions &options = DNK::ParseOptions());
+        // reads through a StreamParser into one document, which holds the whole
+        // source like the others but only once. Use StreamParser itself to not keep
+        // the blocks
+        bool parse(const std::shared_ptr<DNK::Document> &target, int fd, const DNK::ParseOptions &options = DNK::ParseOptions());
+
+        // A change to the document text: `removed` bytes at `offset` replaced by `inserted`
+        struct Edit {
+            uint32 offset;
+            uint32 removed;
+            std::string inserted;
+            Edit(uint32 offset, uint32 removed, const std::string &inserted){
+                this->offset = offset;
+                this->removed = removed;
+                this->inserted = inserted;
+            }
+        };
+
+        // Applies an edit to a parsed document (offsets into arena.text()) and parses
+        // again only the smallest block around it. Edits that add or remove brackets,
+        // '%' or quotes fall back to a full parse
+        bool reparse(const std::shared_ptr<DNK::Document> &target, const DNK::Edit &edit, const DNK::ParseOptions &options = DNK::ParseOptions());
+
+        // Compiled documents (.dnkc): the parsed arena in its in-memory layout, keyed
+        // by DNK::Hash::bytes of the source. See parser/Compiled.cpp for the format.
+        // Reading takes the source too, a file whose text isn't that source is refused
+        std::string compiledPath(const std::string &dir, uint64 hash);
+        bool writeCompiled(const std::shared_ptr<DNK::Document> &doc, const std::string &path, uint64 hash);
+        bool readCompiled(const std::shared_ptr<DNK::Document> &target, const std::string &path, uint64 hash, std::string_view source);
 
         // Render
-        bool RenderImage(const std::shared_ptr<DNK::Document> &doc, const std::string &filename, unsigned pd);
+        struct RenderOptions {
+            unsigned pd;            // pixel density, text is 7px per pd
+            std::string cacheDir;   // keeps rasterized glyphs across runs (.dnkg), empty for none
+            bool sdf;               // glyphs as distance fields sampled at any pd, one raster for every density
+            unsigned threads;       // > 1 rasterizes the document's glyphs in parallel before drawing
+            RenderOptions(){
+                pd = 3;
+                sdf = false;
+                threads = 1;
+            }
+        };
+        bool RenderImage(const std::shared_ptr<DNK::Document> &doc, const std::string &filename, const DNK::RenderOptions &options = DNK::RenderOptions());
     }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <type_traits>
+
+#include "../common/Tools.hpp"
+#include "../dinky.hpp"
+
+/*
+    .dnkc layout. Offsets are from the start of the file and nothing else is
+    stored as an address, so the file can be mapped anywhere:
+
+        Header
+        text     source bytes, every Span points into it
+        nodes    DNK::Node[]
+        runs     DNK::Span[]
+        styles   DNK::Attribute[]
+        params   DNK::Attribute[]
+        keys     DNK::Span[]
+
+    Sections start 8-byte aligned and hold the arena arrays byte for byte.
+    `order` and `layout` reject files written on another endianness or by a
+    build whose structs differ; bump VERSION on any other format change
+*/
+namespace Compiled {
+
+    static_assert(std::is_trivially_copyable<DNK::Node>::value, "DNK::Node must stay trivially copyable");
+    static_assert(std::is_trivially_copyable<DNK::Attribute>::value, "DNK::Attribute must stay trivially copyable");
+    static_assert(std::is_trivially_copyable<DNK::Span>::value, "DNK::Span must stay trivially copyable");
+
+    static const char MAGIC[4] = { 'D', 'N', 'K', 'C' };
+    static const uint32 VERSION = 2;
+    static const uint32 ORDER = 0x01020304;
+    static const uint32 LAYOUT = sizeof(DNK::Node) | (sizeof(DNK::Attribute) << 8) | (sizeof(DNK::Span) << 16);
+
+    namespace SectionType {
+        enum SectionType : unsigned {
+            TEXT,
+            NODES,
+            RUNS,
+            STYLES,
+            PARAMS,
+            KEYS,
+            TOTAL
+        };
+    }
+
+    struct Section {
+        uint64 offset;
+        uint64 count;   // elements, bytes for TEXT
+    };
+
+    struct Header {
+        char magic[4];
+        uint32 version;
+        uint32 order;
+        uint32 layout;
+        uint64 hash;
+        uint32 body;
+        uint32 reserved;
+        Compiled::Section sections[Compiled::SectionType::TOTAL];
+    };
+
+    static const size_t ELEMENT[Compiled::SectionType::TOTAL] = {
+        1,
+        sizeof(DNK::Node),
+        sizeof(DNK::Span),
+        sizeof(DNK::Attribute),
+        sizeof(DNK::Attribute),
+        sizeof(DNK::Span)
+    };
+
+    static bool inText(const DNK::Span &span, uint64 size){
+        return (uint64)span.offset + span.length <= size;
+    }
+
+    static bool inRange(uint32 first, uint32 count, size_t size){
+        return (uint64)first + count <= size;
+    }
+
+    static bool validAttributes(const std::vector<DNK::Attribute> &list, const DNK::Arena &arena, uint64 size){
+        for(auto &attr : list){
+            if(attr.key >= DNK::AttributeKey::CUSTOM + arena.keys.size() || attr.value.type > DNK::ValueType::BOOL ||
+                attr.value.unit > DNK::Unit::PIXEL || !Compiled::inText(attr.value.str, size)){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Every index and span of a loaded arena lands inside it, and the nodes
+    // reachable from body form a tree. A corrupt file is turned down here rather
+    // than read out of bounds during layout. Nodes reparse left unreachable are
+    // range checked only
+    static bool valid(const DNK::Arena &arena, uint32 body){
+        auto size = arena.text().size();
+        auto count = arena.nodes.size();
+        if(size >= DNK::Node::NONE || body >= count){
+            return false;
+        }
+        auto link = [&](uint32 node){
+            return node == DNK::Node::NONE || node < count;
+        };
+        for(auto &node : arena.nodes){
+            if(node.type > DNK::NodeType::CARDVIDEO || !link(node.parent) || !link(node.firstChild) || !link(node.nextSibling) ||
+                node.start > node.end || node.end > size ||
+                !Compiled::inRange(node.firstRun, node.runCount, arena.runs.size()) ||
+                !Compiled::inRange(node.firstStyle, node.styleCount, arena.styles.size()) ||
+                !Compiled::inRange(node.firstParam, node.paramCount, arena.params.size())){
+                return false;
+            }
+        }
+        for(auto &run : arena.runs){
+            if(!Compiled::inText(run, size)){
+                return false;
+            }
+        }
+        for(auto &key : arena.keys){
+            if(!Compiled::inText(key, size)){
+                return false;
+            }
+        }
+        if(!Compiled::validAttributes(arena.styles, arena, size) || !Compiled::validAttributes(arena.params, arena, size)){
+            return false;
+        }
+        // each reachable node is seen once, from its own parent
+        std::vector<bool> seen(count, false);
+        std::vector<uint32> stack(1, body);
+        seen[body] = true;
+        while(!stack.empty()){
+            auto parent = stack.back();
+            stack.pop_back();
+            for(auto child = arena.nodes[parent].firstChild; child != DNK::Node::NONE; child = arena.nodes[child].nextSibling){
+                if(seen[child] || arena.nodes[child].parent != parent){
+                    return false;
+                }
+                seen[child] = true;
+                stack.push_back(child);
+            }
+        }
+        return true;
+    }
+
+    // DNK::Value has padding after `unit`, written from zeroed copies so the same
+    // document always makes the same file
+    static std::vector<DNK::Attribute> settle(const std::vector<DNK::Attribute> &list){
+        std::vector<DNK::Attribute> out(list.size());
+        if(out.size() > 0){
+            memset(out.data(), 0, out.size() * sizeof(DNK::Attribute));
+        }
+        for(size_t i = 0; i < list.size(); ++i){
+            out[i].key = list[i].key;
+            out[i].value.type = list[i].value.type;
+            out[i].value.unit = list[i].value.unit;
+            out[i].value.color = list[i].value.color;
+            out[i].value.str = list[i].value.str;
+        }
+        return out;
+    }
+
+    template<typename T>
+    static void load(std::vector<T> &out, const DNK::File::View &view, const Compiled::Section &section){
+        out.resize(section.count);
+        if(section.count > 0){
+            memcpy(out.data(), view.data + section.offset, section.count * sizeof(T));
+        }
+    }
+
+}
+
+std::string DNK::compiledPath(const std::string &dir, uint64 hash){
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.dnkc", static_cast<unsigned long long>(hash));
+    return dir + DNK::File::dirSep() + name;
+}
+
+bool DNK::writeCompiled(const std::shared_ptr<DNK::Document> &doc, const std::string &path, uint64 hash){
+    auto &arena = doc->arena;
+    if(doc->body == DNK::Node::NONE){
+        fprintf(stderr, "DNK::writeCompiled: Document wasn't parsed\n");
+        return false;
+    }
+    auto text = arena.text();
+    auto styles = Compiled::settle(arena.styles);
+    auto params = Compiled::settle(arena.params);
+    const void *parts[Compiled::SectionType::TOTAL] = {
+        text.data(), arena.nodes.data(), arena.runs.data(), styles.data(), params.data(), arena.keys.data()
+    };
+    uint64 counts[Compiled::SectionType::TOTAL] = {
+        text.size(), arena.nodes.size(), arena.runs.size(), arena.styles.size(), arena.params.size(), arena.keys.size()
+    };
+
+    Compiled::Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Compiled::MAGIC, sizeof(header.magic));
+    header.version = Compiled::VERSION;
+    header.order = Compiled::ORDER;
+    header.layout = Compiled::LAYOUT;
+    header.hash = hash;
+    header.body = doc->body;
+    uint64 offset = sizeof(header);
+    for(unsigned i = 0; i < Compiled::SectionType::TOTAL; ++i){
+        offset = (offset + 7) & ~7ULL;
+        header.sections[i].offset = offset;
+        header.sections[i].count = counts[i];
+        offset += counts[i] * Compiled::ELEMENT[i];
+    }
+
+    // written aside and renamed so readers never map a half written file
+    auto tmp = path + "." + std::to_string(getpid()) + ".part";
+    auto file = fopen(tmp.c_str(), "wb");
+    if(file == NULL){
+        fprintf(stderr, "DNK::writeCompiled: Failed to create '%s'\n", tmp.c_str());
+        return false;
+    }
+    static const char zeros[8] = { 0 };
+    auto ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64 written = sizeof(header);
+    for(unsigned i = 0; ok && i < Compiled::SectionType::TOTAL; ++i){
+        auto pad = header.sections[i].offset - written;
+        auto bytes = counts[i] * Compiled::ELEMENT[i];
+        ok = fwrite(zeros, 1, pad, file) == pad && (bytes == 0 || fwrite(parts[i], 1, bytes, file) == bytes);
+        written += pad + bytes;
+    }
+    ok = fclose(file) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0){
+        fprintf(stderr, "DNK::writeCompiled: Failed to write '%s'\n", path.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool DNK::readCompiled(const std::shared_ptr<DNK::Document> &target, const std::string &path, uint64 hash, std::string_view source){
+    if(!DNK::File::exists(path)){
+        return false;
+    }
+    auto view = DNK::File::map(path);
+    if(!view){
+        return false;
+    }
+    Compiled::Header header;
+    if(view->size < sizeof(header)){
+        fprintf(stderr, "DNK::readCompiled: '%s' is truncated\n", path.c_str());
+        return false;
+    }
+    memcpy(&header, view->data, sizeof(header));
+    if(memcmp(header.magic, Compiled::MAGIC, sizeof(header.magic)) != 0 || header.version != Compiled::VERSION ||
+        header.order != Compiled::ORDER || header.layout != Compiled::LAYOUT || header.hash != hash){
+        fprintf(stderr, "DNK::readCompiled: '%s' is stale or from another build, ignoring it\n", path.c_str());
+        return false;
+    }
+    for(unsigned i = 0; i < Compiled::SectionType::TOTAL; ++i){
+        auto &section = header.sections[i];
+        if(section.offset > view->size || section.count > (view->size - section.offset) / Compiled::ELEMENT[i]){
+            fprintf(stderr, "DNK::readCompiled: '%s' is truncated\n", path.c_str());
+            return false;
+        }
+    }
+    // the hash only picks the file, the text has to be the very source
+    auto &text = header.sections[Compiled::SectionType::TEXT];
+    if(text.count != source.size() || memcmp(view->data + text.offset, source.data(), source.size()) != 0){
+        fprintf(stderr, "DNK::readCompiled: '%s' was compiled from another source, ignoring it\n", path.c_str());
+        return false;
+    }
+
+    // the text stays in the mapping, the arrays are single block copies. They
+    // only replace the document's once they've been checked
+    DNK::Arena arena;
+    arena.input = view;
+    arena.external = std::string_view(view->data + text.offset, text.count);
+    Compiled::load(arena.nodes, *view, header.sections[Compiled::SectionType::NODES]);
+    Compiled::load(arena.runs, *view, header.sections[Compiled::SectionType::RUNS]);
+    Compiled::load(arena.styles, *view, header.sections[Compiled::SectionType::STYLES]);
+    Compiled::load(arena.params, *view, header.sections[Compiled::SectionType::PARAMS]);
+    Compiled::load(arena.keys, *view, header.sections[Compiled::SectionType::KEYS]);
+    if(!Compiled::valid(arena, header.body)){
+        fprintf(stderr, "DNK::readCompiled: '%s' is corrupt\n", path.c_str());
+        return false;
+    }
+    target->arena = std::move(arena);
+    target->body = header.body;
+    return true;
+}
@@ -0,0 +1,152 @@
+#include "../common/Tools.hpp"
+#include "Parser.hpp"
+
+namespace Parser {
+
+    static bool reparseAll(DNK::Document &doc, std::string &text, const DNK::ParseOptions &options){
+        doc.arena.clear();
+        doc.arena.source.swap(text);
+        return Parser::parse(doc, options);
+    }
+
+    // Deepest block whose brackets strictly enclose [offset, offset+removed), the
+    // root when there is none. Siblings are in source order so each level stops
+    // at the first one starting past the edit
+    static uint32 enclosing(const DNK::Document &doc, uint32 offset, uint32 removed, unsigned &depth){
+        auto &nodes = doc.arena.nodes;
+        auto found = doc.body;
+        depth = 0;
+        auto child = nodes[found].firstChild;
+        while(child != DNK::Node::NONE){
+            auto &n = nodes[child];
+            if(n.start >= offset){
+                break;
+            }
+            if(offset + removed < n.end){
+                found = child;
+                ++depth;
+                child = n.firstChild;
+                continue;
+            }
+            child = n.nextSibling;
+        }
+        return found;
+    }
+
+    static bool changesStructure(std::string_view str){
+        // brackets can move block boundaries and '%' or '\'' can turn a ']' into
+        // media content, either may reach past the enclosing block
+        return str.find_first_of("[]%'") != std::string_view::npos;
+    }
+
+    static void shift(uint32 &offset, uint32 from, int64 diff){
+        if(offset >= from){
+            offset = static_cast<uint32>(offset + diff);
+        }
+    }
+
+    static uint32 countSubtree(const DNK::Document &doc, uint32 node){
+        auto &nodes = doc.arena.nodes;
+        uint32 count = 0;
+        std::vector<uint32> stack;
+        stack.push_back(node);
+        while(stack.size() > 0){
+            auto index = stack.back();
+            stack.pop_back();
+            ++count;
+            for(auto child = nodes[index].firstChild; child != DNK::Node::NONE; child = nodes[child].nextSibling){
+                stack.push_back(child);
+            }
+        }
+        return count;
+    }
+
+}
+
+bool DNK::reparse(const std::shared_ptr<DNK::Document> &target, const DNK::Edit &edit, const DNK::ParseOptions &options){
+    auto &doc = *target;
+    auto &arena = doc.arena;
+    auto text = arena.text();
+    if(edit.offset > text.size() || edit.removed > text.size() - edit.offset){
+        fprintf(stderr, "DNK::reparse: Edit at %u (%u bytes) is outside the document (%zu bytes)\n", edit.offset, edit.removed, text.size());
+        return false;
+    }
+    std::string next;
+    next.reserve(text.size() - edit.removed + edit.inserted.size());
+    next.append(text.substr(0, edit.offset));
+    next.append(edit.inserted);
+    next.append(text.substr(edit.offset + edit.removed));
+    if(next.size() > options.maxSize || next.size() >= DNK::Node::NONE){
+        fprintf(stderr, "Fatal error parsing document: Source is too big (%zu bytes, limit is %zu)\n", next.size(), options.maxSize);
+        return false;
+    }
+
+    // Anything the block-local path can't prove equivalent to a full parse gets one
+    if(doc.body == DNK::Node::NONE || Parser::changesStructure(edit.inserted) ||
+        Parser::changesStructure(text.substr(edit.offset, edit.removed)) || arena.dead > arena.nodes.size() / 2){
+        return Parser::reparseAll(doc, next, options);
+    }
+    unsigned depth = 0;
+    auto node = Parser::enclosing(doc, edit.offset, edit.removed, depth);
+    if(node == doc.body){
+        return Parser::reparseAll(doc, next, options);
+    }
+    auto start = arena.nodes[node].start;
+    auto end = arena.nodes[node].end;
+    // custom key names are spans too; one first seen inside the block may be used elsewhere
+    for(auto &key : arena.keys){
+        if(key.offset >= start && key.offset < end){
+            return Parser::reparseAll(doc, next, options);
+        }
+    }
+
+    auto diff = static_cast<int64>(edit.inserted.size()) - static_cast<int64>(edit.removed);
+    auto replaced = Parser::countSubtree(doc, node);
+    auto kept = arena.nodes.size() - arena.dead - replaced;
+    DNK::Document part;
+    part.arena.source = next.substr(start, end + diff - start);
+    // same limits as for the whole document, counted from where the block sits
+    auto local = options;
+    local.maxDepth = options.maxDepth - (depth - 1);
+    local.maxNodes = kept < options.maxNodes ? options.maxNodes - kept + 1 : 0;
+    if(!Parser::parse(part, local)){
+        return false;
+    }
+    auto top = part.arena.nodes[part.body].firstChild;
+    if(top == DNK::Node::NONE || part.arena.nodes[top].nextSibling != DNK::Node::NONE){
+        return Parser::reparseAll(doc, next, options);
+    }
+
+    // Untouched nodes stay where they are, only what follows the block moves
+    for(auto &n : arena.nodes){
+        Parser::shift(n.start, end, diff);
+        Parser::shift(n.end, end, diff);
+    }
+    for(auto &run : arena.runs){
+        Parser::shift(run.offset, end, diff);
+    }
+    for(auto &style : arena.styles){
+        Parser::shift(style.value.str.offset, end, diff);
+    }
+    for(auto &param : arena.params){
+        Parser::shift(param.value.str.offset, end, diff);
+    }
+    for(auto &key : arena.keys){
+        Parser::shift(key.offset, end, diff);
+    }
+    arena.input.reset();
+    arena.external = std::string_view();
+    arena.source.swap(next);
+
+    // the new subtree takes the old one's place among its siblings
+    auto parent = arena.nodes[node].parent;
+    auto after = arena.nodes[node].nextSibling;
+    auto before = DNK::Node::NONE;
+    for(auto child = arena.nodes[parent].firstChild; child != node; child = arena.nodes[child].nextSibling){
+        before = child;
+    }
+    arena.dead += replaced;
+    auto index = Parser::graft(doc, parent, before, part, top, start);
+    arena.nodes[index].nextSibling = after;
+    return true;
+}
@@ -0,0 +1,293 @@
+#include <thread>
+#include <atomic>
+
+#include "../common/Tools.hpp"
+#include "Parser.hpp"
+
+namespace Parser {
+
+    static bool isBlank(std::string_view str){
+        return str.find_first_not_of(" \n") == std::string_view::npos;
+    }
+
+    // Blocks directly inside [from, to), with the tokenizer's rules for media and
+    // styles. False when brackets don't balance, media is unterminated or blocks
+    // nest deeper than `depth` allows; the serial parser then reports it
+    static bool findBlocks(std::string_view text, const Parser::StructuralIndex &index, size_t from, size_t to, unsigned maxDepth, std::vector<DNK::Span> &blocks){
+        unsigned depth = 0;
+        size_t start = 0;
+        auto inMedia = false;
+        auto inQuote = false;
+        for(auto i = index.next(from); i < to; i = index.next(i + 1)){
+            auto c = text[i];
+            if(inMedia){
+                if(c == '\''){
+                    inQuote = !inQuote;
+                }else
+                if(c == '%' && !inQuote){
+                    inMedia = false;
+                }
+                continue;
+            }
+            switch(c){
+                case '%': {
+                    inMedia = true;
+                    inQuote = false;
+                } break;
+                case '!': {
+                    // the style body is not structural, it ends before ' ', '\n', '[' or ']'
+                    auto end = i + 1;
+                    while(end < to && text[end] != ' ' && text[end] != '\n' && text[end] != '[' && text[end] != ']'){
+                        ++end;
+                    }
+                    i = end - 1;
+                } break;
+                case '[': {
+                    if(depth == 0){
+                        start = i;
+                    }
+                    if(++depth > maxDepth){
+                        return false;
+                    }
+                } break;
+                case ']': {
+                    if(depth == 0){
+                        return false;
+                    }
+                    if(--depth == 0){
+                        blocks.push_back(DNK::Span { static_cast<uint32>(start), static_cast<uint32>(i + 1 - start) });
+                    }
+                } break;
+            }
+        }
+        return depth == 0 && !inMedia;
+    }
+
+    /*
+        Blocks that hold nothing but a single block are walked through (the usual
+        root panel around every paragraph). The content of the innermost one, W, is
+        cut before some of its child blocks into chunks that parse on their own as
+        fragments, and the fragments are stitched back in order:
+
+        - nodes keep preorder, so chunk nodes follow W in chunk order
+        - runs, styles and params are committed children first, so each chunk's
+          arrays minus its root tail go in order and W's own entries come last
+        - custom keys are interned in order of appearance, chunk by chunk
+        - W's own text, styles and params are the fragment roots' concatenated, and
+          its type and params come from the last fragment that had media
+
+        Everything ends up at the same index a serial parse would give it
+    */
+    bool parseParallel(DNK::Document &doc, const DNK::ParseOptions &options){
+        auto &arena = doc.arena;
+        auto text = arena.text();
+        Parser::StructuralIndex index;
+        index.build(text);
+
+        std::vector<DNK::Span> wrappers;
+        std::vector<DNK::Span> blocks;
+        size_t from = 0;
+        size_t to = text.size();
+        while(true){
+            blocks.clear();
+            if(wrappers.size() >= options.maxDepth || !Parser::findBlocks(text, index, from, to, options.maxDepth - wrappers.size(), blocks)){
+                return Parser::parseSerial(doc, options, false, &index);
+            }
+            if(blocks.size() != 1 || !Parser::isBlank(text.substr(from, blocks[0].offset - from)) ||
+                !Parser::isBlank(text.substr(blocks[0].offset + blocks[0].length, to - blocks[0].offset - blocks[0].length))){
+                break;
+            }
+            wrappers.push_back(blocks[0]);
+            from = blocks[0].offset + 1;
+            to = blocks[0].offset + blocks[0].length - 1;
+        }
+        if(blocks.size() < 2){
+            return Parser::parseSerial(doc, options, false, &index);
+        }
+
+        // a few chunks per thread so one slow chunk doesn't hold the others up
+        std::vector<DNK::Span> chunks;
+        auto goal = (to - from) / (options.threads * 4) + 1;
+        auto start = from;
+        for(auto &block : blocks){
+            if(block.offset > start && block.offset - start >= goal){
+                chunks.push_back(DNK::Span { static_cast<uint32>(start), static_cast<uint32>(block.offset - start) });
+                start = block.offset;
+            }
+        }
+        chunks.push_back(DNK::Span { static_cast<uint32>(start), static_cast<uint32>(to - start) });
+
+        auto local = options;
+        local.threads = 1;
+        local.maxDepth = options.maxDepth - wrappers.size();
+        local.maxNodes = DNK::Node::NONE - 1; // checked on the whole tree below
+        std::vector<DNK::Document> parts(chunks.size());
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        auto work = [&](){
+            while(!failed){
+                auto i = next++;
+                if(i >= chunks.size()){
+                    return;
+                }
+                // each chunk tokenizes over its slice of the index built above
+                parts[i].arena.external = text.substr(chunks[i].offset, chunks[i].length);
+                auto slice = index.slice(chunks[i].offset, chunks[i].length);
+                if(!Parser::parseSerial(parts[i], local, true, &slice)){
+                    failed = true;
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for(unsigned t = 1; t < options.threads && t < chunks.size(); ++t){
+            pool.push_back(std::thread(work));
+        }
+        work();
+        for(auto &thread : pool){
+            thread.join();
+        }
+        if(failed){
+            arena.nodes.clear();
+            arena.runs.clear();
+            arena.styles.clear();
+            arena.params.clear();
+            arena.keys.clear();
+            return Parser::parseSerial(doc, options, false, &index);
+        }
+
+        // root, the wrappers and W
+        arena.nodes.resize(wrappers.size() + 1);
+        arena.nodes[0].start = 0;
+        arena.nodes[0].end = text.size();
+        for(uint32 i = 0; i < wrappers.size(); ++i){
+            auto &wrapper = arena.nodes[i + 1];
+            wrapper.parent = i;
+            wrapper.start = wrappers[i].offset;
+            wrapper.end = wrappers[i].offset + wrappers[i].length;
+            arena.nodes[i].firstChild = i + 1;
+        }
+        auto w = static_cast<uint32>(wrappers.size());
+
+        std::unordered_map<std::string_view, uint32> keys;
+        std::vector<uint32> remap;
+        std::vector<DNK::Span> ownRuns;
+        std::vector<DNK::Attribute> ownStyles;
+        std::vector<DNK::Attribute> ownParams;
+        unsigned ownType = DNK::NodeType::PANEL;
+        auto last = DNK::Node::NONE;
+        auto relink = [](uint32 link, uint32 base){
+            return link == DNK::Node::NONE ? link : link + base;
+        };
+        for(size_t c = 0; c < parts.size(); ++c){
+            auto &part = parts[c];
+            auto &src = part.arena;
+            auto &root = src.nodes[part.body];
+            auto delta = chunks[c].offset;
+
+            remap.resize(src.keys.size());
+            for(size_t k = 0; k < src.keys.size(); ++k){
+                auto name = part.getSpan(src.keys[k]);
+                auto found = keys.find(name);
+                if(found == keys.end()){
+                    auto span = src.keys[k];
+                    span.offset += delta;
+                    arena.keys.push_back(span);
+                    found = keys.emplace(name, DNK::AttributeKey::CUSTOM + arena.keys.size() - 1).first;
+                }
+                remap[k] = found->second;
+            }
+            auto attribute = [&](DNK::Attribute attr){
+                if(attr.key >= DNK::AttributeKey::CUSTOM){
+                    attr.key = remap[attr.key - DNK::AttributeKey::CUSTOM];
+                }
+                attr.value.str.offset += delta;
+                return attr;
+            };
+
+            // chunk node i > 0 lands at base + i, its top level hangs off W
+            auto base = static_cast<uint32>(arena.nodes.size() - 1);
+            auto runBase = static_cast<uint32>(arena.runs.size());
+            auto styleBase = static_cast<uint32>(arena.styles.size());
+            auto paramBase = static_cast<uint32>(arena.params.size());
+            for(uint32 i = 1; i < src.nodes.size(); ++i){
+                auto node = src.nodes[i];
+                node.parent = node.parent == part.body ? w : node.parent + base;
+                node.firstChild = relink(node.firstChild, base);
+                node.nextSibling = relink(node.nextSibling, base);
+                node.start += delta;
+                node.end += delta;
+                node.firstRun += runBase;
+                node.firstStyle += styleBase;
+                node.firstParam += paramBase;
+                arena.nodes.push_back(node);
+            }
+            for(auto child = root.firstChild; child != DNK::Node::NONE; child = src.nodes[child].nextSibling){
+                if(last == DNK::Node::NONE){
+                    arena.nodes[w].firstChild = child + base;
+                }else
+                if(child == root.firstChild){
+                    arena.nodes[last].nextSibling = child + base;
+                }
+                last = child + base;
+            }
+            for(uint32 i = 0; i < src.runs.size(); ++i){
+                auto run = src.runs[i];
+                run.offset += delta;
+                (i < root.firstRun ? arena.runs : ownRuns).push_back(run);
+            }
+            for(uint32 i = 0; i < src.styles.size(); ++i){
+                (i < root.firstStyle ? arena.styles : ownStyles).push_back(attribute(src.styles[i]));
+            }
+            if(root.type != DNK::Node::NONE){
+                ownType = root.type;
+                ownParams.clear();
+            }
+            for(uint32 i = 0; i < src.params.size(); ++i){
+                if(i < root.firstParam){
+                    arena.params.push_back(attribute(src.params[i]));
+                }else
+                if(root.type != DNK::Node::NONE){
+                    ownParams.push_back(attribute(src.params[i]));
+                }
+            }
+        }
+        if(arena.nodes.size() > options.maxNodes){
+            fprintf(stderr, "Parser::read: Document has more than %zu blocks\n", options.maxNodes);
+            arena.clear();
+            return false;
+        }
+
+        // W closes, then the wrappers around it, as they would serially
+        auto hasContent = false;
+        for(auto &run : ownRuns){
+            if(!Parser::isBlank(std::string_view(text.data() + run.offset, run.length))){
+                hasContent = true;
+                break;
+            }
+        }
+        auto &own = arena.nodes[w];
+        if(hasContent){
+            own.firstRun = arena.runs.size();
+            own.runCount = ownRuns.size();
+            arena.runs.insert(arena.runs.end(), ownRuns.begin(), ownRuns.end());
+        }
+        own.firstStyle = arena.styles.size();
+        own.styleCount = ownStyles.size();
+        arena.styles.insert(arena.styles.end(), ownStyles.begin(), ownStyles.end());
+        own.firstParam = arena.params.size();
+        own.paramCount = ownParams.size();
+        arena.params.insert(arena.params.end(), ownParams.begin(), ownParams.end());
+        own.type = ownType;
+        Parser::resolveStyles(arena, own);
+        if(hasContent && own.type == DNK::NodeType::PANEL){
+            own.type = DNK::NodeType::TEXT;
+        }
+        for(uint32 i = 0; i < w; ++i){
+            arena.nodes[i].firstStyle = arena.styles.size();
+            arena.nodes[i].firstParam = arena.params.size();
+        }
+        doc.body = 0;
+        return true;
+    }
+
+}
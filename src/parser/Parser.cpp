@@ -0,0 +1,578 @@
+#include <charconv>
+
+#include "../common/Tools.hpp"
+#include "Parser.hpp"
+
+
+std::shared_ptr<DNK::Document> DNK::build(const std::string &title, const std::string &author, unsigned type){
+    auto doc = std::make_shared<DNK::Document>();
+
+    doc->title = title;
+    doc->author = author;
+    doc->type = type;
+
+    return doc;
+}
+
+namespace Parser {
+
+    static size_t findNextFragment(const Parser::StructuralIndex &index, std::string_view input, char find, size_t from){
+        // will ignore things '
+        auto inStr = false;
+        for(size_t i = index.next(from); i < input.size(); i = index.next(i + 1)){
+            if(input[i] == '\''){
+                inStr = !inStr;
+            }
+            if(inStr){
+                continue;
+            }
+            if(input[i] == find){
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    static bool isStyleEnd(char c){
+        return c == ' ' || c == '\n' || c == '[' || c == ']';
+    }
+
+    bool Tokenizer::next(Parser::Token &token){
+        auto size = this->input.size();
+        token.offset = this->cursor;
+        token.str = std::string_view();
+        token.value = std::string_view();
+
+        if(this->cursor >= size){
+            token.type = TokenType::END;
+            return false;
+        }
+
+        switch(this->input[this->cursor]){
+            case '[': {
+                token.type = TokenType::OPEN;
+                ++this->cursor;
+            } break;
+            case ']': {
+                token.type = TokenType::CLOSE;
+                ++this->cursor;
+            } break;
+            // Helpers
+            case '%': {
+                auto closed = Parser::findNextFragment(this->index, this->input, '%', this->cursor + 1);
+                if(closed == std::string_view::npos){
+                    token.type = TokenType::ERROR;
+                    token.str = "unterminated '%' media block";
+                    return false;
+                }
+                token.type = TokenType::MEDIA;
+                token.str = this->input.substr(this->cursor + 1, closed - this->cursor - 1);
+                this->cursor = closed + 1;
+            } break;
+            // Styling
+            case '!': {
+                auto end = this->cursor + 1;
+                while(end < size && !Parser::isStyleEnd(this->input[end])){
+                    ++end;
+                }
+                auto body = this->input.substr(this->cursor + 1, end - this->cursor - 1);
+                auto eq = body.find('=');
+                token.type = TokenType::STYLE;
+                if(eq == std::string_view::npos){
+                    token.str = body;
+                    token.value = body.substr(body.size());
+                }else{
+                    token.str = body.substr(0, eq);
+                    token.value = body.substr(eq + 1);
+                }
+                // the separator belongs to the style
+                if(end < size && (this->input[end] == ' ' || this->input[end] == '\n')){
+                    ++end;
+                }
+                this->cursor = end;
+            } break;
+            // Simple text
+            default: {
+                // quotes only matter inside media
+                auto end = this->index.next(this->cursor + 1);
+                while(end < size && this->input[end] == '\''){
+                    end = this->index.next(end + 1);
+                }
+                token.type = TokenType::TEXT;
+                token.str = this->input.substr(this->cursor, end - this->cursor);
+                this->cursor = end;
+            } break;
+        }
+        return true;
+    }
+
+    std::vector<std::string_view> splitAroundFragment(std::string_view input, char find){
+        // will ignore things '
+        std::vector<std::string_view> output;
+        auto inStr = false;
+        size_t start = 0;
+        for(size_t i = 0; i < input.size(); ++i){
+            auto c = input[i];
+            if(c == '\''){
+                inStr = !inStr;
+            }
+            if(c == find && !inStr){
+                if(i > start){
+                    output.push_back(input.substr(start, i - start));
+                }
+                start = i + 1;
+            }
+        }
+        if(start < input.size()){
+            output.push_back(input.substr(start));
+        }
+        return output;
+    }
+
+    uint32 Builder::intern(std::string_view name){
+        auto known = DNK::AttributeKey::key(name);
+        if(known != -1){
+            return known;
+        }
+        auto it = this->keys.find(name);
+        if(it != this->keys.end()){
+            return it->second;
+        }
+        auto key = static_cast<uint32>(DNK::AttributeKey::CUSTOM + this->arena.keys.size());
+        this->arena.keys.push_back(this->span(name));
+        this->keys[name] = key;
+        return key;
+    }
+
+    static bool parseNumber(std::string_view input, float &number){
+        if(input.size() == 0 || input.find_first_not_of("-.0123456789") != std::string_view::npos){
+            return false;
+        }
+        auto end = input.data() + input.size();
+        auto result = std::from_chars(input.data(), end, number);
+        return result.ec == std::errc() && result.ptr == end;
+    }
+
+    static bool parseColor(std::string_view input, uint32 &color){
+        // #RRGGBB or #RRGGBBAA
+        if(input.size() != 7 && input.size() != 9){
+            return false;
+        }
+        auto end = input.data() + input.size();
+        auto result = std::from_chars(input.data() + 1, end, color, 16);
+        if(result.ec != std::errc() || result.ptr != end){
+            return false;
+        }
+        if(input.size() == 7){
+            color = (color << 8) | 0xFF;
+        }
+        return true;
+    }
+
+    static bool endsWith(std::string_view input, std::string_view suffix){
+        return input.size() > suffix.size() && input.substr(input.size() - suffix.size()) == suffix;
+    }
+
+    DNK::Value parseValue(const Parser::Builder &builder, std::string_view input, bool param){
+        DNK::Value value;
+        value.type = DNK::ValueType::STRING;
+        value.unit = DNK::Unit::NONE;
+        value.number = 0.0f;
+
+        // quoted literals are strings, except for percentages: '%' closes a media
+        // block so quoting is the only way to write one there
+        if(input.size() > 1 && input[0] == '\'' && input[input.size()-1] == '\''){
+            input = input.substr(1, input.size()-2);
+            value.str = builder.span(input);
+            if(Parser::endsWith(input, "%") && Parser::parseNumber(input.substr(0, input.size()-1), value.number)){
+                value.type = DNK::ValueType::LENGTH;
+                value.unit = DNK::Unit::PERCENT;
+            }else{
+                value.number = 0.0f;
+            }
+            return value;
+        }
+        value.str = builder.span(input);
+
+        // a bare !flag is on
+        if(input.size() == 0 || input == "true" || input == "false"){
+            value.type = DNK::ValueType::BOOL;
+            value.flag = input != "false";
+            return value;
+        }
+
+        if(input[0] == '#'){
+            if(Parser::parseColor(input, value.color)){
+                value.type = DNK::ValueType::COLOR;
+            }
+            return value;
+        }
+
+        auto digits = input;
+        if(Parser::endsWith(input, "%")){
+            value.unit = DNK::Unit::PERCENT;
+            digits = input.substr(0, input.size()-1);
+        }else
+        if(Parser::endsWith(input, "rem")){
+            value.unit = DNK::Unit::REM;
+            digits = input.substr(0, input.size()-3);
+        }else
+        if(Parser::endsWith(input, "px")){
+            value.unit = DNK::Unit::PIXEL;
+            digits = input.substr(0, input.size()-2);
+        }
+        if(!Parser::parseNumber(digits, value.number)){
+            value.unit = DNK::Unit::NONE;
+            value.number = 0.0f;
+            return value;
+        }
+        // params without a unit have always been rem, styles are plain numbers
+        if(value.unit == DNK::Unit::NONE){
+            value.type = param ? DNK::ValueType::LENGTH : DNK::ValueType::NUMBER;
+            value.unit = param ? DNK::Unit::REM : DNK::Unit::NONE;
+        }else{
+            value.type = DNK::ValueType::LENGTH;
+        }
+        return value;
+    }
+
+    void appendText(std::string &str, char &lastChar, std::string_view run){
+        // newlines are dropped and repeated spaces collapse into one. Clean segments
+        // are appended whole instead of char by char
+        size_t start = 0;
+        for(size_t i = 0; i < run.size(); ++i){
+            auto c = run[i];
+            if(c == '\n' || (c == ' ' && lastChar == ' ')){
+                str.append(run.data() + start, i - start);
+                start = i + 1;
+                continue;
+            }
+            lastChar = c;
+        }
+        str.append(run.data() + start, run.size() - start);
+    }
+
+    template<typename T>
+    static void commit(std::vector<T> &pending, size_t base, std::vector<T> &target, uint32 &first, uint32 &count){
+        first = target.size();
+        count = pending.size() - base;
+        target.insert(target.end(), pending.begin() + base, pending.end());
+        pending.resize(base);
+    }
+
+    void resolveStyles(const DNK::Arena &arena, DNK::Node &node){
+        for(uint32 i = 0; i < node.styleCount; ++i){
+            auto &style = arena.styles[node.firstStyle + i];
+            switch(style.key){
+                case DNK::AttributeKey::MARGIN: {
+                    node.margin = style.value.rem();
+                } break;
+                case DNK::AttributeKey::SPACING: {
+                    node.spacing = style.value.rem();
+                } break;
+                case DNK::AttributeKey::LINE_HEIGHT: {
+                    node.lineHeight = style.value.rem();
+                } break;
+            }
+        }
+    }
+
+    static void open(Parser::Builder &builder, size_t offset){
+        auto &arena = builder.arena;
+        auto index = static_cast<uint32>(arena.nodes.size());
+        arena.nodes.push_back(DNK::Node());
+        arena.nodes[index].start = offset;
+        if(builder.stack.size() > 0){
+            auto &parent = builder.stack.back();
+            arena.nodes[index].parent = parent.node;
+            if(parent.lastChild == DNK::Node::NONE){
+                arena.nodes[parent.node].firstChild = index;
+            }else{
+                arena.nodes[parent.lastChild].nextSibling = index;
+            }
+            parent.lastChild = index;
+        }
+        Parser::Frame frame;
+        frame.node = index;
+        frame.lastChild = DNK::Node::NONE;
+        frame.offset = offset;
+        frame.runBase = builder.runs.size();
+        frame.styleBase = builder.styles.size();
+        frame.paramBase = builder.params.size();
+        frame.hasContent = false;
+        builder.stack.push_back(frame);
+    }
+
+    static void close(Parser::Builder &builder, size_t end){
+        auto &arena = builder.arena;
+        auto &frame = builder.stack.back();
+        auto &node = arena.nodes[frame.node];
+        node.end = end;
+        // text made only of blanks is no text at all. A fragment root keeps its runs,
+        // whoever merges it decides once all of its pieces are known
+        auto keep = builder.fragment && builder.stack.size() == 1;
+        if(frame.hasContent || keep){
+            Parser::commit(builder.runs, frame.runBase, arena.runs, node.firstRun, node.runCount);
+        }else{
+            builder.runs.resize(frame.runBase);
+        }
+        Parser::commit(builder.styles, frame.styleBase, arena.styles, node.firstStyle, node.styleCount);
+        Parser::commit(builder.params, frame.paramBase, arena.params, node.firstParam, node.paramCount);
+        Parser::resolveStyles(arena, node);
+        if(frame.hasContent && node.type == DNK::NodeType::PANEL && !keep){
+            node.type = DNK::NodeType::TEXT;
+        }
+        builder.stack.pop_back();
+    }
+
+    static void media(Parser::Builder &builder, Parser::Frame &frame, std::string_view media){
+        auto empty = media.find(' ');
+        auto name = std::string(media.substr(0, empty));
+        builder.arena.nodes[frame.node].type = DNK::NodeType::type(DNK::String::upper(name));
+        builder.params.resize(frame.paramBase);
+        if(empty == std::string_view::npos){
+            return;
+        }
+        auto items = Parser::splitAroundFragment(media.substr(empty + 1), ' ');
+        for(size_t i = 0; i < items.size(); ++i){
+            auto subitems = Parser::splitAroundFragment(items[i], ':');
+            if(subitems.size() < 2){
+                continue;
+            }
+            builder.params.push_back(DNK::Attribute { builder.intern(subitems[0]), Parser::parseValue(builder, subitems[1], true) });
+        }
+    }
+
+    uint32 read(Parser::Builder &builder, bool root){
+        // brackets are matched by the stack itself in this one pass, nesting costs
+        // no recursion and no rescanning
+        auto &arena = builder.arena;
+        auto &options = builder.options;
+        auto bottom = builder.stack.size();
+
+        Parser::open(builder, builder.tokenizer.cursor);
+        auto index = builder.stack.back().node;
+        if(root && builder.fragment){
+            // no media seen yet, see Parser::parseParallel
+            arena.nodes[index].type = DNK::Node::NONE;
+        }
+
+        Parser::Token token;
+        while(builder.tokenizer.next(token)){
+            auto &frame = builder.stack.back();
+            switch(token.type){
+                // Helpers
+                case TokenType::MEDIA: {
+                    Parser::media(builder, frame, token.str);
+                } break;
+                // Styling
+                case TokenType::STYLE: {
+                    builder.styles.push_back(DNK::Attribute { builder.intern(token.str), Parser::parseValue(builder, token.value, false) });
+                } break;
+                // Child
+                case TokenType::OPEN: {
+                    if(builder.stack.size() > options.maxDepth){
+                        fprintf(stderr, "Parser::read: Blocks are nested deeper than %u levels at offset %zu\n", options.maxDepth, token.offset);
+                        builder.stack.resize(bottom);
+                        return DNK::Node::NONE;
+                    }
+                    if(arena.nodes.size() >= options.maxNodes){
+                        fprintf(stderr, "Parser::read: Document has more than %zu blocks\n", options.maxNodes);
+                        builder.stack.resize(bottom);
+                        return DNK::Node::NONE;
+                    }
+                    Parser::open(builder, token.offset);
+                } break;
+                case TokenType::CLOSE: {
+                    if(builder.stack.size() - bottom == 1){
+                        if(root){
+                            fprintf(stderr, "Parser::read: Unexpected ']' at offset %zu\n", token.offset);
+                            builder.stack.resize(bottom);
+                            return DNK::Node::NONE;
+                        }
+                        Parser::close(builder, token.offset + 1);
+                        return index;
+                    }
+                    Parser::close(builder, token.offset + 1);
+                } break;
+                // Simple text
+                case TokenType::TEXT: {
+                    builder.runs.push_back(builder.span(token.str));
+                    if(!frame.hasContent){
+                        frame.hasContent = token.str.find_first_not_of(" \n") != std::string_view::npos;
+                    }
+                } break;
+            }
+        }
+
+        if(token.type == TokenType::ERROR){
+            fprintf(stderr, "Parser::read: Error at offset %zu: %.*s\n", token.offset, (int)token.str.size(), token.str.data());
+            builder.stack.resize(bottom);
+            return DNK::Node::NONE;
+        }
+        if(!root || builder.stack.size() - bottom > 1){
+            fprintf(stderr, "Parser::read: Block opened at offset %zu is missing its closing ']'\n", builder.stack.back().offset);
+            builder.stack.resize(bottom);
+            return DNK::Node::NONE;
+        }
+
+        Parser::close(builder, builder.tokenizer.input.size());
+        return index;
+    }
+}
+
+namespace Parser {
+
+    bool parse(DNK::Document &doc, const DNK::ParseOptions &options){
+        auto &arena = doc.arena;
+        auto text = arena.text();
+        if(text.size() > options.maxSize || text.size() >= DNK::Node::NONE){
+            fprintf(stderr, "Fatal error parsing document: Source is too big (%zu bytes, limit is %zu)\n", text.size(), options.maxSize);
+            arena.clear();
+            return false;
+        }
+        arena.nodes.clear();
+        arena.runs.clear();
+        arena.styles.clear();
+        arena.params.clear();
+        arena.keys.clear();
+        arena.dead = 0;
+        if(options.threads > 1 && text.size() >= Parser::PARALLEL_MIN){
+            return Parser::parseParallel(doc, options);
+        }
+        return Parser::parseSerial(doc, options, false);
+    }
+
+    bool parseSerial(DNK::Document &doc, const DNK::ParseOptions &options, bool fragment, const Parser::StructuralIndex *index){
+        auto &arena = doc.arena;
+        Parser::Tokenizer tokenizer = index != NULL ? Parser::Tokenizer(arena.text(), *index) : Parser::Tokenizer(arena.text());
+        Parser::Builder builder(arena, tokenizer, options);
+        builder.fragment = fragment;
+        doc.body = Parser::read(builder, true);
+        if(doc.body == DNK::Node::NONE){
+            arena.clear();
+            return false;
+        }
+        return true;
+    }
+
+    static uint32 remapKey(DNK::Document &target, const DNK::Document &src, uint32 key, uint32 delta){
+        if(key < DNK::AttributeKey::CUSTOM){
+            return key;
+        }
+        auto span = src.arena.keys[key - DNK::AttributeKey::CUSTOM];
+        auto found = target.findKey(src.getSpan(span));
+        if(found != DNK::Node::NONE){
+            return found;
+        }
+        span.offset += delta;
+        target.arena.keys.push_back(span);
+        return DNK::AttributeKey::CUSTOM + target.arena.keys.size() - 1;
+    }
+
+    static void adoptAttributes(DNK::Document &target, std::vector<DNK::Attribute> &list, const DNK::Document &src, const std::vector<DNK::Attribute> &from, uint32 first, uint32 count, uint32 delta){
+        for(uint32 i = 0; i < count; ++i){
+            auto attr = from[first + i];
+            attr.key = Parser::remapKey(target, src, attr.key, delta);
+            attr.value.str.offset += delta;
+            list.push_back(attr);
+        }
+    }
+
+    void adopt(DNK::Document &target, uint32 node, const DNK::Document &src, uint32 from, uint32 delta){
+        auto &arena = target.arena;
+        auto &origin = src.arena.nodes[from];
+        auto firstRun = static_cast<uint32>(arena.runs.size());
+        for(uint32 i = 0; i < origin.runCount; ++i){
+            auto run = src.arena.runs[origin.firstRun + i];
+            run.offset += delta;
+            arena.runs.push_back(run);
+        }
+        auto firstStyle = static_cast<uint32>(arena.styles.size());
+        Parser::adoptAttributes(target, arena.styles, src, src.arena.styles, origin.firstStyle, origin.styleCount, delta);
+        auto firstParam = static_cast<uint32>(arena.params.size());
+        Parser::adoptAttributes(target, arena.params, src, src.arena.params, origin.firstParam, origin.paramCount, delta);
+
+        auto &n = arena.nodes[node];
+        n.type = origin.type;
+        n.start = origin.start + delta;
+        n.end = origin.end + delta;
+        n.firstRun = firstRun;
+        n.runCount = origin.runCount;
+        n.firstStyle = firstStyle;
+        n.styleCount = origin.styleCount;
+        n.firstParam = firstParam;
+        n.paramCount = origin.paramCount;
+        n.margin = origin.margin;
+        n.spacing = origin.spacing;
+        n.lineHeight = origin.lineHeight;
+    }
+
+    static uint32 append(DNK::Document &target, uint32 parent, uint32 after, const DNK::Document &src, uint32 from, uint32 delta){
+        auto &arena = target.arena;
+        auto index = static_cast<uint32>(arena.nodes.size());
+        arena.nodes.push_back(DNK::Node());
+        arena.nodes[index].parent = parent;
+        if(after != DNK::Node::NONE){
+            arena.nodes[after].nextSibling = index;
+        }else
+        if(parent != DNK::Node::NONE){
+            arena.nodes[parent].firstChild = index;
+        }
+        Parser::adopt(target, index, src, from, delta);
+        return index;
+    }
+
+    uint32 graft(DNK::Document &target, uint32 parent, uint32 after, const DNK::Document &src, uint32 node, uint32 delta){
+        struct Step {
+            uint32 dst;
+            uint32 child;
+            uint32 last;
+        };
+        auto top = Parser::append(target, parent, after, src, node, delta);
+        std::vector<Step> stack;
+        stack.push_back(Step { top, src.arena.nodes[node].firstChild, DNK::Node::NONE });
+        while(stack.size() > 0){
+            auto &step = stack.back();
+            if(step.child == DNK::Node::NONE){
+                stack.pop_back();
+                continue;
+            }
+            auto from = step.child;
+            auto dst = step.dst;
+            auto last = step.last;
+            step.child = src.arena.nodes[from].nextSibling;
+            auto index = Parser::append(target, dst, last, src, from, delta);
+            stack.back().last = index;
+            stack.push_back(Step { index, src.arena.nodes[from].firstChild, DNK::Node::NONE });
+        }
+        return top;
+    }
+}
+
+bool DNK::parse(const std::shared_ptr<DNK::Document> &target, const std::string &src, const DNK::ParseOptions &options){
+    if(src.size() > options.maxSize || src.size() >= DNK::Node::NONE){
+        fprintf(stderr, "Fatal error parsing document: Source is too big (%zu bytes, limit is %zu)\n", src.size(), options.maxSize);
+        return false;
+    }
+    target->arena.clear();
+    target->arena.source = src;
+    return Parser::parse(*target, options);
+}
+
+bool DNK::parse(const std::shared_ptr<DNK::Document> &target, const std::shared_ptr<DNK::File::View> &input, const DNK::ParseOptions &options){
+    target->arena.clear();
+    target->arena.input = input;
+    target->arena.external = input->str();
+    return Parser::parse(*target, options);
+}
+
+std::string DNK::Document::getText(uint32 node) const {
+    std::string str;
+    char lastChar = 0;
+    auto &n = arena.nodes[node];
+    for(uint32 i = 0; i < n.runCount; ++i){
+        Parser::appendText(str, lastChar, getSpan(arena.runs[n.firstRun + i]));
+    }
+    return str;
+}
@@ -0,0 +1,112 @@
+#ifndef DNK_PARSER_HPP
+    #define DNK_PARSER_HPP
+
+    #include <string_view>
+    #include "../dinky.hpp"
+    #include "Structural.hpp"
+
+    namespace Parser {
+
+        namespace TokenType {
+            enum TokenType : unsigned {
+                OPEN,   // [
+                CLOSE,  // ]
+                MEDIA,  // %token key:value ...%
+                STYLE,  // !key or !key=value
+                TEXT,   // raw run between structural characters (may hold newlines and repeated spaces)
+                END,
+                ERROR
+            };
+        }
+
+        struct Token {
+            unsigned type;
+            size_t offset;
+            std::string_view str;   // MEDIA: inner content, STYLE: key, TEXT: run, ERROR: message
+            std::string_view value; // STYLE: value (empty for flags)
+        };
+
+        // Single pass over one immutable source buffer. Every token is a view into
+        // the buffer, nothing is copied.
+        struct Tokenizer {
+            std::string_view input;
+            size_t cursor;
+            Parser::StructuralIndex index;
+
+            Tokenizer(std::string_view input){
+                this->input = input;
+                this->cursor = 0;
+                this->index.build(input);
+            }
+
+            // `index` already covers input, a slice of a bigger one for fragments
+            Tokenizer(std::string_view input, const Parser::StructuralIndex &index){
+                this->input = input;
+                this->cursor = 0;
+                this->index = index;
+            }
+
+            bool next(Parser::Token &token);
+        };
+
+        // A node that is still open, one per unmatched '['
+        struct Frame {
+            uint32 node;
+            uint32 lastChild;
+            size_t offset;
+            size_t runBase;
+            size_t styleBase;
+            size_t paramBase;
+            bool hasContent;
+        };
+
+        // Fills a document arena from a tokenizer with an explicit stack of open
+        // nodes. Runs, styles and params of the open nodes are kept in stack order
+        // so each node's entries end up contiguous in the arena once it closes
+        struct Builder {
+            DNK::Arena &arena;
+            Parser::Tokenizer &tokenizer;
+            DNK::ParseOptions options;
+            std::vector<Parser::Frame> stack;
+            std::vector<DNK::Span> runs;
+            std::vector<DNK::Attribute> styles;
+            std::vector<DNK::Attribute> params;
+            std::unordered_map<std::string_view, uint32> keys;
+            bool fragment; // a run of siblings cut out of a bigger block, see Parser::parseParallel
+
+            Builder(DNK::Arena &arena, Parser::Tokenizer &tokenizer, const DNK::ParseOptions &options) : arena(arena), tokenizer(tokenizer) {
+                this->options = options;
+                this->fragment = false;
+            }
+
+            DNK::Span span(std::string_view view) const {
+                return DNK::Span { static_cast<uint32>(view.data() - tokenizer.input.data()), static_cast<uint32>(view.size()) };
+            }
+
+            uint32 intern(std::string_view name);
+        };
+
+        std::vector<std::string_view> splitAroundFragment(std::string_view input, char find);
+        DNK::Value parseValue(const Parser::Builder &builder, std::string_view input, bool param);
+        void appendText(std::string &str, char &lastChar, std::string_view run);
+
+        // inputs smaller than this parse faster on one thread
+        static const size_t PARALLEL_MIN = 256 * 1024;
+
+        void resolveStyles(const DNK::Arena &arena, DNK::Node &node);
+        uint32 read(Parser::Builder &builder, bool root);
+        // parses doc.arena.text() in place, on options.threads threads when it's worth it
+        bool parse(DNK::Document &doc, const DNK::ParseOptions &options);
+        // `index` is doc.arena.text()'s when the caller has it, NULL builds one
+        bool parseSerial(DNK::Document &doc, const DNK::ParseOptions &options, bool fragment, const Parser::StructuralIndex *index = NULL);
+        bool parseParallel(DNK::Document &doc, const DNK::ParseOptions &options);
+
+        // Copy a node's own text, styles and params (not its children) from another
+        // document. src's source bytes must already sit at +delta in target's source
+        void adopt(DNK::Document &target, uint32 node, const DNK::Document &src, uint32 from, uint32 delta);
+        // Copy the subtree at src's node under parent, linked after the sibling `after`
+        // (or as first child when NONE). Returns the new node
+        uint32 graft(DNK::Document &target, uint32 parent, uint32 after, const DNK::Document &src, uint32 node, uint32 delta);
+    }
+
+#endif
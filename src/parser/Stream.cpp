@@ -0,0 +1,183 @@
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "../common/Tools.hpp"
+#include "Parser.hpp"
+
+DNK::StreamParser::StreamParser(const DNK::ParseOptions &options){
+    this->options = options;
+    this->total = 0;
+    this->blockStart = 0;
+    this->blockBegin = 0;
+    this->sink = NULL;
+    this->depth = 0;
+    this->inMedia = false;
+    this->inQuote = false;
+    this->inStyle = false;
+}
+
+bool DNK::StreamParser::emit(){
+    if(!this->block){
+        this->block = std::make_shared<DNK::Document>();
+    }
+    // the block is parsed where it was received, nothing is copied
+    auto &buffer = this->sink != NULL ? *this->sink : this->pending;
+    this->block->arena.clear();
+    this->block->arena.external = std::string_view(buffer).substr(this->blockBegin);
+    auto ok = Parser::parse(*this->block, this->options);
+    if(!ok){
+        fprintf(stderr, "StreamParser: Failed to parse the block at offset %zu\n", this->blockStart);
+    }else
+    if(this->onBlock && !this->onBlock(*this->block)){
+        ok = false;
+    }
+    this->block->arena.external = std::string_view();
+    this->pending.clear();
+    return ok;
+}
+
+bool DNK::StreamParser::push(const char *data, size_t size){
+    if(this->total + size > this->options.maxSize){
+        fprintf(stderr, "StreamParser: Input is too big (limit is %zu bytes)\n", this->options.maxSize);
+        return false;
+    }
+    // Same rules as Parser::Tokenizer: brackets inside media don't count, brackets
+    // ending a style do, quotes only matter in media
+    auto &buffer = this->sink != NULL ? *this->sink : this->pending;
+    size_t from = 0;
+    for(size_t i = 0; i < size; ++i){
+        auto c = data[i];
+        if(this->inMedia){
+            if(c == '\''){
+                this->inQuote = !this->inQuote;
+            }else
+            if(c == '%' && !this->inQuote){
+                this->inMedia = false;
+            }
+            continue;
+        }
+        if(this->inStyle){
+            if(c != '[' && c != ']'){
+                this->inStyle = c != ' ' && c != '\n';
+                continue;
+            }
+            this->inStyle = false;
+        }
+        switch(c){
+            case '%': {
+                this->inMedia = true;
+                this->inQuote = false;
+            } break;
+            case '!': {
+                this->inStyle = true;
+            } break;
+            case '[': {
+                if(this->depth == 0){
+                    // the root keeps a break where the block was, same as a token boundary
+                    this->rootSrc.append(data + from, i - from);
+                    this->rootSrc += '\n';
+                    this->blockStart = this->total + i;
+                    this->blockBegin = buffer.size();
+                    from = i;
+                }
+                if(++this->depth > this->options.maxDepth){
+                    fprintf(stderr, "StreamParser: Blocks are nested deeper than %u levels at offset %zu\n", this->options.maxDepth, this->total + i);
+                    return false;
+                }
+            } break;
+            case ']': {
+                if(this->depth == 0){
+                    fprintf(stderr, "StreamParser: Unexpected ']' at offset %zu\n", this->total + i);
+                    return false;
+                }
+                if(--this->depth == 0){
+                    buffer.append(data + from, i + 1 - from);
+                    from = i + 1;
+                    if(!this->emit()){
+                        return false;
+                    }
+                }
+            } break;
+        }
+    }
+    if(this->depth > 0){
+        buffer.append(data + from, size - from);
+    }else{
+        this->rootSrc.append(data + from, size - from);
+    }
+    this->total += size;
+    return true;
+}
+
+bool DNK::StreamParser::read(int fd){
+    std::vector<char> buffer(64 * 1024);
+    while(true){
+        auto n = ::read(fd, buffer.data(), buffer.size());
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            fprintf(stderr, "StreamParser::read: Failed to read input: %s\n", strerror(errno));
+            return false;
+        }
+        if(n == 0){
+            return true;
+        }
+        if(!this->push(buffer.data(), n)){
+            return false;
+        }
+    }
+}
+
+bool DNK::StreamParser::finish(DNK::Document &root){
+    if(this->inMedia){
+        fprintf(stderr, "StreamParser: Input ended inside a '%%' media block\n");
+        return false;
+    }
+    if(this->depth > 0){
+        fprintf(stderr, "StreamParser: Block opened at offset %zu is missing its closing ']'\n", this->blockStart);
+        return false;
+    }
+    root.arena.source.swap(this->rootSrc);
+    this->rootSrc.clear();
+    return Parser::parse(root, this->options);
+}
+
+bool DNK::parse(const std::shared_ptr<DNK::Document> &target, int fd, const DNK::ParseOptions &options){
+    auto &doc = *target;
+    auto &arena = doc.arena;
+    arena.clear();
+    arena.nodes.push_back(DNK::Node());
+    doc.body = 0;
+
+    // Blocks are received straight into the document source and parsed there, so
+    // their bytes are held once. Only the source and nodes of the document grow
+    // with the input, the block document is reused for the next one
+    auto last = DNK::Node::NONE;
+    DNK::StreamParser stream(options);
+    stream.sink = &arena.source;
+    stream.onBlock = [&](const DNK::Document &block){
+        if(arena.nodes.size() + block.arena.nodes.size() > options.maxNodes){
+            fprintf(stderr, "DNK::parse: Document has more than %zu blocks\n", options.maxNodes);
+            return false;
+        }
+        // the block ends where the source does
+        auto delta = static_cast<uint32>(arena.source.size() - block.arena.text().size());
+        last = Parser::graft(doc, doc.body, last, block, block.arena.nodes[block.body].firstChild, delta);
+        return true;
+    };
+
+    DNK::Document root;
+    if(!stream.read(fd) || !stream.finish(root)){
+        arena.clear();
+        doc.body = DNK::Node::NONE;
+        return false;
+    }
+    auto delta = static_cast<uint32>(arena.source.size());
+    arena.source.append(root.arena.source);
+    Parser::adopt(doc, doc.body, root, root.body, delta);
+    arena.nodes[doc.body].start = 0;
+    arena.nodes[doc.body].end = arena.source.size();
+    return true;
+}
@@ -0,0 +1,105 @@
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__SSE2__)) && !defined(DNK_NO_SIMD)
+    #include <immintrin.h>
+    #define DNK_STRUCTURAL_X86
+#endif
+
+#include "Structural.hpp"
+
+namespace Parser {
+
+    static bool isStructural(char c){
+        return c == '[' || c == ']' || c == '%' || c == '!' || c == '\'';
+    }
+
+    static uint64 blockScalar(const char *in){
+        uint64 mask = 0;
+        for(unsigned i = 0; i < 64; ++i){
+            if(isStructural(in[i])){
+                mask |= 1ULL << i;
+            }
+        }
+        return mask;
+    }
+
+    #ifdef DNK_STRUCTURAL_X86
+
+        static uint64 blockSSE2(const char *in){
+            const auto open = _mm_set1_epi8('[');
+            const auto close = _mm_set1_epi8(']');
+            const auto percent = _mm_set1_epi8('%');
+            const auto bang = _mm_set1_epi8('!');
+            const auto quote = _mm_set1_epi8('\'');
+            uint64 mask = 0;
+            for(unsigned i = 0; i < 4; ++i){
+                auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 16));
+                auto hit = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, open), _mm_cmpeq_epi8(v, close)),
+                    _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, bang)), _mm_cmpeq_epi8(v, quote))
+                );
+                mask |= static_cast<uint64>(static_cast<uint16>(_mm_movemask_epi8(hit))) << (i * 16);
+            }
+            return mask;
+        }
+
+        __attribute__((target("avx2")))
+        static uint64 blockAVX2(const char *in){
+            const auto open = _mm256_set1_epi8('[');
+            const auto close = _mm256_set1_epi8(']');
+            const auto percent = _mm256_set1_epi8('%');
+            const auto bang = _mm256_set1_epi8('!');
+            const auto quote = _mm256_set1_epi8('\'');
+            uint64 mask = 0;
+            for(unsigned i = 0; i < 2; ++i){
+                auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 32));
+                auto hit = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, open), _mm256_cmpeq_epi8(v, close)),
+                    _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, percent), _mm256_cmpeq_epi8(v, bang)), _mm256_cmpeq_epi8(v, quote))
+                );
+                mask |= static_cast<uint64>(static_cast<uint32>(_mm256_movemask_epi8(hit))) << (i * 32);
+            }
+            return mask;
+        }
+
+    #endif
+
+    std::vector<Parser::StructuralKernel> structuralKernels(){
+        std::vector<Parser::StructuralKernel> kernels;
+        kernels.push_back(Parser::StructuralKernel { "scalar", blockScalar });
+        #ifdef DNK_STRUCTURAL_X86
+            kernels.push_back(Parser::StructuralKernel { "sse2", blockSSE2 });
+            if(__builtin_cpu_supports("avx2")){
+                kernels.push_back(Parser::StructuralKernel { "avx2", blockAVX2 });
+            }
+        #endif
+        return kernels;
+    }
+
+    void StructuralIndex::build(std::string_view input){
+        static const Parser::BlockKernel kernel = Parser::structuralKernels().back().block;
+        build(input, kernel);
+    }
+
+    void StructuralIndex::build(std::string_view input, Parser::BlockKernel kernel){
+        this->size = input.size();
+        this->base = 0;
+        this->bits.resize((input.size() + 63) / 64);
+        this->words = this->bits.data();
+        this->count = this->bits.size();
+
+        size_t full = input.size() / 64;
+        for(size_t i = 0; i < full; ++i){
+            this->bits[i] = kernel(input.data() + i * 64);
+        }
+        // tail is zero padded, NUL is never structural
+        auto rest = input.size() - full * 64;
+        if(rest > 0){
+            char tail[64];
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, input.data() + full * 64, rest);
+            this->bits[full] = kernel(tail);
+        }
+    }
+
+}
@@ -0,0 +1,87 @@
+#ifndef DNK_PARSER_STRUCTURAL_HPP
+    #define DNK_PARSER_STRUCTURAL_HPP
+
+    #include <algorithm>
+    #include <string_view>
+    #include <vector>
+    #include "../common/Types.hpp"
+
+    namespace Parser {
+
+        // One 64-byte block of input to its structural bits
+        typedef uint64 (*BlockKernel)(const char *in);
+
+        struct StructuralKernel {
+            const char *name;
+            Parser::BlockKernel block;
+        };
+
+        // Every block kernel this build and CPU can run, scalar first. build()
+        // takes the last one, the others are there to be checked against it
+        std::vector<Parser::StructuralKernel> structuralKernels();
+
+        // Bit i of bits[i/64] is set when input[i] is one of [ ] % ! '
+        // Built once per input (SSE2/AVX2 when available) so the tokenizer can jump
+        // from one structural character to the next instead of testing every byte.
+        // A slice reads the bits of the index it was cut from, which must outlive it
+        struct StructuralIndex {
+            std::vector<uint64> bits;   // empty in a slice
+            const uint64 *words;        // bits, or the sliced index's
+            size_t count;               // words available
+            size_t base;                // position 0 is bit `base` of words
+            size_t size;
+
+            StructuralIndex(){
+                words = NULL;
+                count = 0;
+                base = 0;
+                size = 0;
+            }
+
+            StructuralIndex(const StructuralIndex &other){
+                *this = other;
+            }
+
+            StructuralIndex &operator=(const StructuralIndex &other){
+                bits = other.bits;
+                words = other.bits.empty() ? other.words : bits.data();
+                count = other.count;
+                base = other.base;
+                size = other.size;
+                return *this;
+            }
+
+            void build(std::string_view input);
+            void build(std::string_view input, Parser::BlockKernel kernel);
+
+            // positions [offset, offset + size) of this index, as positions from 0
+            StructuralIndex slice(size_t offset, size_t size) const {
+                StructuralIndex out;
+                out.words = words;
+                out.count = count;
+                out.base = base + offset;
+                out.size = size;
+                return out;
+            }
+
+            // first structural position >= from, or size when there is none
+            size_t next(size_t from) const {
+                if(from >= size){
+                    return size;
+                }
+                auto at = from + base;
+                auto w = at >> 6;
+                auto mask = words[w] & (~0ULL << (at & 63));
+                while(mask == 0){
+                    if(++w >= count){
+                        return size;
+                    }
+                    mask = words[w];
+                }
+                return std::min((w << 6) + __builtin_ctzll(mask) - base, size);
+            }
+        };
+
+    }
+
+#endif
@@ -0,0 +1,899 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <unordered_set>
+#include <freetype/ftglyph.h>
+
+#include "../common/Tools.hpp"
+#include "Font.hpp"
+
+#define ENCODING_ASCII_RANGE_MIN 32
+#define ENCODING_ASCII_RANGE_MAX 128
+
+namespace FontRender {
+
+    // Needs the registry's lock, FreeType wants faces of one library opened and
+    // closed one at a time. The face reads the registry's mapping of the file
+    static FT_Face openMemory(FontRender::Registry &registry, const std::string &filename){
+        if(registry.library == NULL && FT_Init_FreeType(&registry.library)){
+            fprintf(stderr, "Font::load: Failed to start FreeType: FT_Init_FreeType\n");
+            registry.library = NULL;
+            return NULL;
+        }
+        auto file = registry.file(filename);
+        if(!file){
+            return NULL;
+        }
+
+        FT_Face face;
+        if(FT_New_Memory_Face(registry.library, reinterpret_cast<const FT_Byte*>(file->data), file->size, 0, &face)) {
+            fprintf(stderr, "Font::genMapping: Failed loading font '%s: FT_New_Memory_Face\n", filename.c_str());
+            return NULL;
+        }
+        return face;
+    }
+
+    // Needs the registry's lock. A face of its own at the font's size, for a worker
+    static FT_Face newFace(FontRender::Font &font){
+        auto face = FontRender::openMemory(*font.registry, font.filename);
+        if(face != NULL && FT_Set_Char_Size(face, 0, font.size << 6, 96, 96)){
+            fprintf(stderr, "Font::genMapping: Failed loading font '%s': FT_Set_Char_Size\n", font.filename.c_str());
+            FT_Done_Face(face);
+            return NULL;
+        }
+        return face;
+    }
+
+    // Needs the registry's lock. Gives the font a size on the file's shared face
+    static bool openFace(FontRender::Font &font){
+        if(font.face != NULL){
+            return true;
+        }
+        if(font.failed){
+            return false;
+        }
+        font.failed = true;
+        auto face = font.registry->face(font.filename);
+        if(face == NULL){
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(face->lock);
+        if(FT_New_Size(face->face, &font.faceSize)){
+            fprintf(stderr, "Font::genMapping: Failed loading font '%s': FT_New_Size\n", font.filename.c_str());
+            font.faceSize = NULL;
+            return false;
+        }
+        if(FT_Activate_Size(font.faceSize) || FT_Set_Char_Size(face->face, 0, font.size << 6, 96, 96)){
+            fprintf(stderr, "Font::genMapping: Failed loading font '%s': FT_Set_Char_Size\n", font.filename.c_str());
+            FT_Done_Size(font.faceSize);
+            font.faceSize = NULL;
+            return false;
+        }
+        font.face = face;
+        font.failed = false;
+        return true;
+    }
+
+    // 8-point sequential Euclidean distance transform. Cells hold the offset to
+    // their nearest seed, seeds start at (0, 0) and everything else far away
+    static void sweep(std::vector<DNK::Vec2<int>> &grid, int w, int h){
+        auto length = [](const DNK::Vec2<int> &o){
+            return o.x * o.x + o.y * o.y;
+        };
+        auto compare = [&](int x, int y, int ox, int oy){
+            if(x + ox < 0 || y + oy < 0 || x + ox >= w || y + oy >= h){
+                return;
+            }
+            auto other = grid[(x + ox) + (y + oy) * w];
+            other.x += ox;
+            other.y += oy;
+            auto &cell = grid[x + y * w];
+            if(length(other) < length(cell)){
+                cell = other;
+            }
+        };
+        for(int y = 0; y < h; ++y){
+            for(int x = 0; x < w; ++x){
+                compare(x, y, -1, 0);
+                compare(x, y, 0, -1);
+                compare(x, y, -1, -1);
+                compare(x, y, 1, -1);
+            }
+            for(int x = w - 1; x >= 0; --x){
+                compare(x, y, 1, 0);
+            }
+        }
+        for(int y = h - 1; y >= 0; --y){
+            for(int x = w - 1; x >= 0; --x){
+                compare(x, y, 1, 0);
+                compare(x, y, 0, 1);
+                compare(x, y, -1, 1);
+                compare(x, y, 1, 1);
+            }
+            for(int x = 0; x < w; ++x){
+                compare(x, y, -1, 0);
+            }
+        }
+    }
+
+    // Coverage to a distance field SDF_SPREAD pixels wider on every side
+    static std::vector<uint8> toField(const unsigned char *src, unsigned w, unsigned h, int pitch, unsigned &fw, unsigned &fh){
+        int pad = FontRender::SDF_SPREAD;
+        fw = w + pad * 2;
+        fh = h + pad * 2;
+        DNK::Vec2<int> none { 9999, 9999 };
+        DNK::Vec2<int> seed { 0, 0 };
+        std::vector<DNK::Vec2<int>> toInside(fw * fh);
+        std::vector<DNK::Vec2<int>> toOutside(fw * fh);
+        std::vector<bool> inside(fw * fh);
+        for(int y = 0; y < (int)fh; ++y){
+            for(int x = 0; x < (int)fw; ++x){
+                auto i = x + y * fw;
+                int sx = x - pad;
+                int sy = y - pad;
+                inside[i] = sx >= 0 && sy >= 0 && sx < (int)w && sy < (int)h && src[sx + sy * pitch] >= 128;
+                toInside[i] = inside[i] ? seed : none;
+                toOutside[i] = inside[i] ? none : seed;
+            }
+        }
+        FontRender::sweep(toInside, fw, fh);
+        FontRender::sweep(toOutside, fw, fh);
+        std::vector<uint8> field(fw * fh);
+        for(size_t i = 0; i < field.size(); ++i){
+            auto &o = inside[i] ? toOutside[i] : toInside[i];
+            float distance = std::sqrt((float)(o.x * o.x + o.y * o.y)) - 0.5f;
+            if(!inside[i]){
+                distance = -distance;
+            }
+            field[i] = (uint8)std::min(std::max(128.0f + distance * 128.0f / FontRender::SDF_SPREAD, 0.0f), 255.0f);
+        }
+        return field;
+    }
+
+    // A glyph's coverage (or field) and metrics before it has a place in an atlas
+    struct Raster {
+        unsigned id;
+        bool loaded;
+        unsigned w;
+        unsigned h;
+        std::vector<uint8> pixels; // w * h, tightly packed
+        DNK::Vec2<float> orig;
+        DNK::Vec2<float> size;
+        int horBearingY;
+
+        Raster(unsigned id){
+            this->id = id;
+            loaded = false;
+            w = 0;
+            h = 0;
+            horBearingY = 0;
+        }
+    };
+
+    // Loads a glyph into the face's slot at `weight`, its metrics follow the outline
+    static bool loadGlyph(FT_Face face, unsigned id, unsigned weight){
+        if(FT_Load_Glyph(face, id, FT_LOAD_DEFAULT)){
+            return false;
+        }
+        if(weight == FontRender::FontWeight::BOLD){
+            FT_GlyphSlot_Embolden(face->glyph);
+        }
+        return true;
+    }
+
+    // Only touches `face`, so workers with a face each can run it side by side
+    static void rasterize(FT_Face face, unsigned mode, unsigned weight, FontRender::Raster &raster){
+        FT_Glyph glyph;
+        if(face == NULL || !FontRender::loadGlyph(face, raster.id, weight) || FT_Get_Glyph(face->glyph, &glyph)){
+            return;
+        }
+        FT_Glyph_To_Bitmap(&glyph, FT_RENDER_MODE_NORMAL, NULL, true);
+        FT_BitmapGlyph bitmap = reinterpret_cast<FT_BitmapGlyph>(glyph);
+        auto &bm = bitmap->bitmap;
+        if(mode == FontRender::GlyphMode::SDF && bm.width > 0 && bm.rows > 0){
+            // the box takes the spread along, orig is its corner
+            raster.pixels = FontRender::toField(bm.buffer, bm.width, bm.rows, bm.pitch, raster.w, raster.h);
+            raster.orig.x = bitmap->left - (int)FontRender::SDF_SPREAD;
+            raster.orig.y = bitmap->top + (int)FontRender::SDF_SPREAD;
+        }else{
+            raster.w = bm.width;
+            raster.h = bm.rows;
+            raster.pixels.resize(raster.w * raster.h);
+            for(unsigned row = 0; row < raster.h; ++row){
+                memcpy(&raster.pixels[row * raster.w], bm.buffer + row * bm.pitch, raster.w);
+            }
+            raster.orig.x = bitmap->left;
+            raster.orig.y = bitmap->top;
+        }
+        raster.size.x = std::max((float)(face->glyph->advance.x >> 6), (float)bm.width);
+        raster.size.y = std::max((float)(face->glyph->advance.y >> 6), (float)bm.rows);
+        raster.horBearingY = face->glyph->metrics.horiBearingY >> 6;
+        raster.loaded = true;
+        FT_Done_Glyph(glyph);
+    }
+
+    // Needs the font's lock. A glyph that failed to load is kept empty so it
+    // isn't retried for every use
+    static FontRender::Glyph *store(FontRender::Font &font, const FontRender::Raster &raster){
+        if(!raster.loaded){
+            fprintf(stderr, "Font::rasterize: Failed to load glyph %u for font '%s'\n", raster.id, font.filename.c_str());
+        }
+        auto sg = std::make_shared<Glyph>();
+        font.map[raster.id] = sg;
+        font.dirty = true;
+        sg->glyph = raster.id;
+        sg->pixels = font.atlas.add(raster.w, raster.h, raster.pixels.data(), raster.w);
+        sg->pitch = font.atlas.width;
+        sg->box = sg->pixels != NULL ? DNK::Rect<unsigned>(0, 0, raster.w, raster.h) : DNK::Rect<unsigned>(0);
+        sg->orig = raster.orig;
+        sg->size = raster.size;
+        sg->horBearingY = raster.horBearingY;
+        return sg.get();
+    }
+
+    // Needs the font's lock, and its face's with the font's size active when it has one
+    static FontRender::Glyph *rasterize(FontRender::Font &font, unsigned id){
+        auto found = font.map.find(id);
+        if(found != font.map.end()){
+            return found->second.get();
+        }
+        FontRender::Raster raster(id);
+        FontRender::rasterize(font.face != NULL ? font.face->face : NULL, font.mode, font.weight, raster);
+        return FontRender::store(font, raster);
+    }
+
+    // Pen adjustment between two consecutive glyphs, `left` NULL at the start.
+    // Two common glyphs are answered by the table alone. Any other pair missing
+    // from it is asked of the face once, under the font's lock
+    static int kern(FontRender::Font &font, const FontRender::Glyph *left, const FontRender::Glyph *right){
+        if(left == NULL){
+            return 0;
+        }
+        if(font.source){
+            return DNK::Math::round(FontRender::kern(*font.source, left, right) * font.scale);
+        }
+        uint32 pair = (left->glyph << 16) | right->glyph;
+        auto it = std::lower_bound(font.kerning.begin(), font.kerning.end(), pair, [](const FontRender::KernPair &k, uint32 pair){
+            return k.pair < pair;
+        });
+        if(it != font.kerning.end() && it->pair == pair){
+            return it->x;
+        }
+        if(!font.kerns || (std::binary_search(font.common.begin(), font.common.end(), left->glyph) &&
+            std::binary_search(font.common.begin(), font.common.end(), right->glyph))){
+            return 0;
+        }
+        std::lock_guard<std::mutex> guard(font.lock);
+        auto found = font.kerned.find(pair);
+        if(found != font.kerned.end()){
+            return found->second;
+        }
+        auto opened = false;
+        {
+            std::lock_guard<std::mutex> faces(font.registry->lock);
+            opened = FontRender::openFace(font);
+        }
+        int32 x = 0;
+        if(opened){
+            std::lock_guard<std::mutex> face(font.face->lock);
+            FT_Activate_Size(font.faceSize);
+            FT_Vector delta;
+            if(FT_Get_Kerning(font.face->face, left->glyph, right->glyph, FT_KERNING_DEFAULT, &delta) == 0){
+                x = delta.x >> 6;
+            }
+        }
+        // zeros too, so the glyph cache answers the pair next time
+        font.kerned[pair] = x;
+        font.dirty = true;
+        return x;
+    }
+
+    // An SDF font's glyph is its source's field with the metrics at this scale.
+    // Needs the font's lock, takes the source's
+    static FontRender::Glyph *scaled(FontRender::Font &font, unsigned codepoint){
+        auto src = FontRender::glyph(*font.source, codepoint);
+        auto &sg = font.map[src->glyph];
+        if(!sg){
+            sg = std::make_shared<FontRender::Glyph>(*src);
+            sg->orig.x = src->orig.x * font.scale;
+            sg->orig.y = src->orig.y * font.scale;
+            sg->size.x = DNK::Math::round(src->size.x * font.scale);
+            sg->size.y = DNK::Math::round(src->size.y * font.scale);
+            sg->horBearingY = DNK::Math::round(src->horBearingY * font.scale);
+        }
+        return sg.get();
+    }
+
+    // Codepoints the face doesn't cover get its glyph 0. A hit is one atomic
+    // load, a miss resolves under the font's lock and publishes the glyph
+    FontRender::Glyph *glyph(FontRender::Font &font, unsigned codepoint){
+        if(codepoint > 0x10FFFF){
+            codepoint = 0xFFFD;
+        }
+        auto glyph = font.table.get(codepoint);
+        if(glyph != NULL){
+            return glyph;
+        }
+        std::lock_guard<std::mutex> guard(font.lock);
+        // another thread may have got here first
+        glyph = font.table.get(codepoint);
+        if(glyph == NULL){
+            if(font.source){
+                glyph = FontRender::scaled(font, codepoint);
+            }else{
+                auto opened = false;
+                {
+                    std::lock_guard<std::mutex> faces(font.registry->lock);
+                    opened = FontRender::openFace(font);
+                }
+                if(opened){
+                    std::lock_guard<std::mutex> face(font.face->lock);
+                    FT_Activate_Size(font.faceSize);
+                    glyph = FontRender::rasterize(font, FT_Get_Char_Index(font.face->face, codepoint));
+                }else{
+                    glyph = FontRender::rasterize(font, 0);
+                }
+            }
+            font.table.set(codepoint, glyph);
+        }
+        return glyph;
+    }
+
+    void preload(FontRender::Font &font, const std::vector<unsigned> &codepoints, unsigned threads){
+        if(font.source){
+            // scaling a field glyph is only a copy, the source does the work
+            FontRender::preload(*font.source, codepoints, threads);
+            return;
+        }
+        std::lock_guard<std::mutex> guard(font.lock);
+        {
+            std::lock_guard<std::mutex> faces(font.registry->lock);
+            if(!FontRender::openFace(font)){
+                return;
+            }
+        }
+        std::vector<std::pair<unsigned, unsigned>> missing;
+        std::vector<FontRender::Raster> rasters;
+        std::unordered_set<unsigned> queued;
+        // taken after the registry's, never while holding it
+        std::unique_lock<std::mutex> shared(font.face->lock);
+        FT_Activate_Size(font.faceSize);
+        for(auto codepoint : codepoints){
+            if(codepoint > 0x10FFFF){
+                codepoint = 0xFFFD;
+            }
+            if(font.table.get(codepoint) != NULL){
+                continue;
+            }
+            auto id = FT_Get_Char_Index(font.face->face, codepoint);
+            missing.push_back(std::make_pair(codepoint, id));
+            if(font.map.find(id) == font.map.end() && queued.insert(id).second){
+                rasters.push_back(FontRender::Raster(id));
+            }
+        }
+        // the atlas is filled in glyph order whatever thread finished first
+        std::sort(rasters.begin(), rasters.end(), [](const FontRender::Raster &a, const FontRender::Raster &b){
+            return a.id < b.id;
+        });
+
+        std::atomic<size_t> next(0);
+        auto work = [&](FT_Face face){
+            for(auto i = next++; i < rasters.size(); i = next++){
+                FontRender::rasterize(face, font.mode, font.weight, rasters[i]);
+            }
+        };
+        // a glyph slot belongs to its face, so every worker loads through its own
+        std::vector<FT_Face> faces;
+        if(rasters.size() >= FontRender::PARALLEL_MIN && threads > 1){
+            shared.unlock();
+            std::lock_guard<std::mutex> lock(font.registry->lock);
+            for(unsigned t = 1; t < threads && t < rasters.size() / (FontRender::PARALLEL_MIN / 2); ++t){
+                auto face = FontRender::newFace(font);
+                if(face == NULL){
+                    break;
+                }
+                faces.push_back(face);
+            }
+        }
+        std::vector<std::thread> pool;
+        for(auto face : faces){
+            pool.push_back(std::thread(work, face));
+        }
+        if(!shared.owns_lock()){
+            shared.lock();
+            FT_Activate_Size(font.faceSize);
+        }
+        work(font.face->face);
+        shared.unlock();
+        for(auto &thread : pool){
+            thread.join();
+        }
+        if(faces.size() > 0){
+            std::lock_guard<std::mutex> lock(font.registry->lock);
+            for(auto face : faces){
+                FT_Done_Face(face);
+            }
+        }
+
+        for(auto &raster : rasters){
+            FontRender::store(font, raster);
+        }
+        for(auto &m : missing){
+            font.table.set(m.first, font.map[m.second].get());
+        }
+    }
+
+    void pack(FontRender::Font &font, FontRender::Packed &out){
+        std::lock_guard<std::mutex> guard(font.lock);
+        out.kerning = font.kerning;
+        for(auto &k : font.kerned){
+            out.kerning.push_back(FontRender::KernPair { k.first, k.second });
+        }
+        std::sort(out.kerning.begin(), out.kerning.end(), [](const FontRender::KernPair &a, const FontRender::KernPair &b){
+            return a.pair < b.pair;
+        });
+        out.width = font.atlas.width;
+        out.height = 0;
+        out.pixels.clear();
+        out.records.clear();
+        FontRender::Shelves shelves;
+        shelves.reset(out.width);
+        // glyphs shared by several codepoints are stored once
+        std::unordered_map<const FontRender::Glyph*, DNK::Rect<unsigned>> placed;
+        auto add = [&](unsigned codepoint, const FontRender::Glyph *glyph){
+            if(glyph == NULL){
+                return;
+            }
+            auto found = placed.find(glyph);
+            if(found == placed.end()){
+                DNK::Rect<unsigned> box(0);
+                if(glyph->box.w > 0 && glyph->box.w <= out.width){
+                    shelves.place(glyph->box.w, glyph->box.h, box.x, box.y);
+                    box.w = glyph->box.w;
+                    box.h = glyph->box.h;
+                    if(box.y + box.h > out.height){
+                        out.height = box.y + box.h;
+                        out.pixels.resize(out.width * out.height, 0);
+                    }
+                    for(unsigned row = 0; row < box.h; ++row){
+                        memcpy(&out.pixels[box.x + (box.y + row) * out.width], glyph->pixels + row * glyph->pitch, box.w);
+                    }
+                }
+                found = placed.emplace(glyph, box).first;
+            }
+            FontRender::GlyphRecord record;
+            memset(&record, 0, sizeof(record));
+            record.codepoint = codepoint;
+            record.index = glyph->glyph;
+            record.x = found->second.x;
+            record.y = found->second.y;
+            record.w = found->second.w;
+            record.h = found->second.h;
+            record.origX = glyph->orig.x;
+            record.origY = glyph->orig.y;
+            record.horBearingY = glyph->horBearingY;
+            record.sizeX = glyph->size.x;
+            record.sizeY = glyph->size.y;
+            out.records.push_back(record);
+        };
+        for(unsigned cp = 0; cp <= 0x10FFFF; ++cp){
+            if(cp >= 256 && (cp & 0xFF) == 0 && font.table.pages[cp >> 8].load(std::memory_order_acquire) == NULL){
+                cp += 0xFF;
+                continue;
+            }
+            add(cp, font.table.get(cp));
+        }
+    }
+
+    void adopt(FontRender::Font &font, const FontRender::GlyphRecord *records, size_t count, const uint8 *pixels, unsigned width){
+        for(size_t i = 0; i < count; ++i){
+            auto &record = records[i];
+            auto &sg = font.map[record.index];
+            if(!sg){
+                sg = std::make_shared<FontRender::Glyph>();
+                sg->glyph = record.index;
+                sg->box = DNK::Rect<unsigned>(0, 0, record.w, record.h);
+                sg->pixels = record.w > 0 ? pixels + record.x + record.y * width : NULL;
+                sg->pitch = width;
+                sg->orig.x = record.origX;
+                sg->orig.y = record.origY;
+                sg->horBearingY = record.horBearingY;
+                sg->size.x = record.sizeX;
+                sg->size.y = record.sizeY;
+            }
+            font.table.set(record.codepoint, sg.get());
+        }
+    }
+
+    // The common range's glyphs and every nonzero pair of them, the same table
+    // dinky_bake writes out. Only indices and kerning are asked, nothing is
+    // rasterized. Needs the face's lock with the font's size active
+    static void kernCommon(FontRender::Font &font, FT_Face face){
+        font.common.clear();
+        font.kerning.clear();
+        for(unsigned cp = 0; cp < 256; ++cp){
+            if(FontRender::isCommon(cp)){
+                font.common.push_back(FT_Get_Char_Index(face, cp));
+            }
+        }
+        std::sort(font.common.begin(), font.common.end());
+        font.common.erase(std::unique(font.common.begin(), font.common.end()), font.common.end());
+        if(!font.kerns){
+            return;
+        }
+        // both sorted, so the pairs come out in table order
+        for(auto left : font.common){
+            for(auto right : font.common){
+                FT_Vector delta;
+                if(FT_Get_Kerning(face, left, right, FT_KERNING_DEFAULT, &delta) == 0 && (delta.x >> 6) != 0){
+                    font.kerning.push_back(FontRender::KernPair { (left << 16) | right, (int32)(delta.x >> 6) });
+                }
+            }
+        }
+    }
+
+    // Needs the registry's lock
+    static std::shared_ptr<FontRender::Font> loadSize(FontRender::Registry &registry, const std::string &name, const std::string &filename, unsigned size, const std::string &cacheDir, unsigned mode, unsigned weight){
+        if(!DNK::File::exists(filename)){
+            fprintf(stderr, "Font::load: Failed to load font '%s': It doesn't exist\n",  filename.c_str());
+            return std::shared_ptr<FontRender::Font>();
+        }
+        // baked sizes and glyph caches go by what's in the file, not its path
+        auto view = registry.file(filename);
+        if(!view){
+            return std::shared_ptr<FontRender::Font>();
+        }
+        auto hashed = registry.hashes.find(filename);
+        if(hashed == registry.hashes.end()){
+            hashed = registry.hashes.emplace(filename, DNK::Hash::bytes(view->data, view->size)).first;
+        }
+
+        auto font = std::make_shared<FontRender::Font>();
+        font->registry = &registry;
+        font->name = name;
+        font->filename = filename;
+        font->size = size;
+        font->mode = mode;
+        font->weight = weight;
+        font->hash = hashed->second;
+
+#ifndef DNK_NO_BAKED_FONTS
+        // the bundled fonts in every text style at the usual sizes are in the binary
+        // and glyphs draw straight from its tables, the face is only opened for a
+        // codepoint that wasn't baked
+        auto baked = FontRender::findBaked(font->hash, size, mode, weight);
+        if(baked != NULL){
+            font->vertAdvance = baked->vertAdvance;
+            font->advanceX = baked->advanceX;
+            font->horiBearingY = baked->horiBearingY;
+            font->avgBearingY = baked->avgBearingY;
+            font->atlas.init(baked->width, std::max(256u, size * 4));
+            FontRender::adopt(*font, baked->glyphs, baked->count, baked->pixels, baked->width);
+            font->kerning.assign(baked->kerning, baked->kerning + baked->kernCount);
+            font->kerns = baked->kerns;
+            // every common codepoint was baked
+            for(unsigned i = 0; i < baked->count; ++i){
+                if(FontRender::isCommon(baked->glyphs[i].codepoint)){
+                    font->common.push_back(baked->glyphs[i].index);
+                }
+            }
+            std::sort(font->common.begin(), font->common.end());
+            font->common.erase(std::unique(font->common.begin(), font->common.end()), font->common.end());
+            return font;
+        }
+#endif
+
+        // wide enough for a couple of rows of the printable ASCII range
+        font->atlas.init(std::max(256u, size * 16), std::max(256u, size * 4));
+
+        // a cached size brings its metrics along and FreeType stays closed
+        if(cacheDir != ""){
+            font->cache = FontRender::cachePath(cacheDir, font->hash, size, font->mode, font->weight);
+            if(FontRender::readCache(*font, font->cache)){
+                return font;
+            }
+        }
+
+        if(!FontRender::openFace(*font)){
+            return std::shared_ptr<FontRender::Font>();
+        }
+
+        std::lock_guard<std::mutex> guard(font->face->lock);
+        FT_Activate_Size(font->faceSize);
+        auto face = font->face->face;
+        auto &metrics = font->faceSize->metrics;
+        font->vertAdvance = metrics.height >> 6;
+        font->advanceX = metrics.max_advance >> 6;
+        font->horiBearingY = metrics.ascender >> 6;
+
+        font->kerns = FT_HAS_KERNING(face);
+
+        // The baseline sits at the tallest printable ASCII glyph whatever the text
+        // uses, which only needs their metrics, not their bitmaps
+        for(unsigned i = ENCODING_ASCII_RANGE_MIN; i < ENCODING_ASCII_RANGE_MAX; ++i){
+            if(!FontRender::loadGlyph(face, FT_Get_Char_Index(face, i), weight)){
+                continue;
+            }
+            font->avgBearingY = std::max(font->avgBearingY, (int)(face->glyph->metrics.horiBearingY >> 6));
+        }
+        FontRender::kernCommon(*font, face);
+        font->dirty = true;
+
+        printf("Font: loaded '%s' (%ipx)\n", filename.c_str(), size);
+
+        return font;
+    }
+
+    Registry::Registry(){
+        head = NULL;
+        library = NULL;
+    }
+
+    Registry::~Registry(){
+        auto entry = head.load();
+        while(entry != NULL){
+            auto next = entry->next;
+            delete entry;
+            entry = next;
+        }
+        // the fonts' sizes went with them, then the faces and the library
+        for(auto &face : faces){
+            FT_Done_Face(face.second->face);
+        }
+        faces.clear();
+        if(library != NULL){
+            FT_Done_FreeType(library);
+        }
+    }
+
+    std::shared_ptr<DNK::File::View> Registry::file(const std::string &filename){
+        auto found = files.find(filename);
+        if(found != files.end()){
+            return found->second;
+        }
+        auto view = DNK::File::map(filename);
+        if(view){
+            files[filename] = view;
+        }
+        return view;
+    }
+
+    FontRender::Face *Registry::face(const std::string &filename){
+        auto found = faces.find(filename);
+        if(found != faces.end()){
+            return found->second.get();
+        }
+        auto face = FontRender::openMemory(*this, filename);
+        if(face == NULL){
+            return NULL;
+        }
+        auto &shared = faces[filename];
+        shared.reset(new FontRender::Face());
+        shared->face = face;
+        return shared.get();
+    }
+
+    FontRender::Font *Registry::find(const std::string &name) const {
+        for(auto entry = head.load(std::memory_order_acquire); entry != NULL; entry = entry->next){
+            if(entry->name == name){
+                return entry->font.get();
+            }
+        }
+        return NULL;
+    }
+
+    bool Registry::load(const std::string &name, const std::string &filename, unsigned size, const std::string &cacheDir, unsigned mode, unsigned weight){
+        std::lock_guard<std::mutex> guard(lock);
+        auto existing = find(name);
+        if(existing != NULL && existing->filename == filename && existing->size == size && existing->mode == mode && existing->weight == weight){
+            return true;
+        }
+        // entries are never unlinked, a reload puts the new font in front of the old
+        auto publish = [&](const std::string &name, const std::shared_ptr<FontRender::Font> &font){
+            head.store(new Entry { name, font, head.load(std::memory_order_relaxed) }, std::memory_order_release);
+        };
+
+        if(mode != FontRender::GlyphMode::SDF){
+            auto font = FontRender::loadSize(*this, name, filename, size, cacheDir, mode, weight);
+            if(!font){
+                return false;
+            }
+            publish(name, font);
+            return true;
+        }
+
+        // every SDF size of a file and weight draws from the one field font registered under it
+        auto key = (weight == FontRender::FontWeight::BOLD ? "sdf:bold:" : "sdf:") + filename;
+        std::shared_ptr<FontRender::Font> source;
+        for(auto entry = head.load(std::memory_order_relaxed); entry != NULL && !source; entry = entry->next){
+            if(entry->name == key){
+                source = entry->font;
+            }
+        }
+        if(!source){
+            source = FontRender::loadSize(*this, key, filename, FontRender::SDF_SIZE, cacheDir, mode, weight);
+            if(!source){
+                return false;
+            }
+            publish(key, source);
+        }
+        auto font = std::make_shared<FontRender::Font>();
+        font->registry = this;
+        font->name = name;
+        font->filename = filename;
+        font->size = size;
+        font->mode = mode;
+        font->weight = weight;
+        font->source = source;
+        font->scale = (float)size / (float)source->size;
+        font->vertAdvance = DNK::Math::round(source->vertAdvance * font->scale);
+        font->advanceX = DNK::Math::round(source->advanceX * font->scale);
+        font->horiBearingY = DNK::Math::round(source->horiBearingY * font->scale);
+        font->avgBearingY = DNK::Math::round(source->avgBearingY * font->scale);
+        publish(name, font);
+        return true;
+    }
+
+    void Registry::flush(){
+        for(auto entry = head.load(std::memory_order_acquire); entry != NULL; entry = entry->next){
+            auto &font = *entry->font;
+            if(font.cache != "" && font.dirty.exchange(false) && !FontRender::writeCache(font, font.cache)){
+                font.dirty = true;
+            }
+        }
+    }
+
+    FontRender::Registry &registry(){
+        static FontRender::Registry shared;
+        return shared;
+    }
+
+    bool load(const std::string &name, const std::string &filename, unsigned size, const std::string &cacheDir, unsigned mode, unsigned weight){
+        return FontRender::registry().load(name, filename, size, cacheDir, mode, weight);
+    }
+
+    // resolve once per text run, not per glyph
+    FontRender::Font *find(const std::string &name){
+        auto font = FontRender::registry().find(name);
+        if(font == NULL){
+            fprintf(stderr, "Font::find: Failed to find font '%s'\n", name.c_str());
+        }
+        return font;
+    }
+
+    void flush(){
+        FontRender::registry().flush();
+    }
+
+    void render(FontRender::Font &font, const std::string &text, const DNK::Vec2<unsigned> &pos, const DNK::Color &color, DNK::Bitmap *target){
+        DNK::Vec2<int> cursor { 0 , 0 };
+        const FontRender::Glyph *last = NULL;
+        for(size_t i = 0; i < text.size();){
+            auto glyph = FontRender::glyph(font, DNK::String::decodeUTF8(text, i));
+            cursor.x += FontRender::kern(font, last, glyph);
+            last = glyph;
+            if(font.source && glyph->box.w > 0){
+                target->pasteField(glyph->pixels, glyph->pitch, glyph->box.w, glyph->box.h,
+                    (float)pos.x + cursor.x + glyph->orig.x, (float)pos.y + cursor.y + font.avgBearingY - glyph->orig.y, font.scale, FontRender::SDF_SPREAD, color);
+            }else
+            if(glyph->box.w > 0){
+                auto p = pos + DNK::Vec2<unsigned>(cursor.x + glyph->orig.x, cursor.y + (- glyph->horBearingY) + font.avgBearingY);
+                target->pasteMask(glyph->pixels, glyph->pitch, glyph->box.w, glyph->box.h, (int)p.x, (int)p.y, color);
+            }
+            cursor.x += glyph->size.x;
+        }
+    }
+
+    DNK::Vec2<unsigned> getDimensions(FontRender::Font &font, const std::string &text){
+        DNK::Vec2<unsigned> dims(0);
+        dims.y = font.avgBearingY;
+        const FontRender::Glyph *last = NULL;
+        for(size_t i = 0; i < text.size();){
+            auto glyph = FontRender::glyph(font, DNK::String::decodeUTF8(text, i));
+            dims.x += FontRender::kern(font, last, glyph);
+            dims.x += glyph->size.x;
+            last = glyph;
+        }
+        return dims;
+    }
+
+    // Glyph boxes where render() would put them. Blending the same colour twice
+    // over a pixel isn't the same as blending once, so only words whose boxes
+    // don't touch get a composited mask
+    static void compose(FontRender::Font &font, FontRender::Word &word){
+        struct Placed {
+            const FontRender::Glyph *glyph;
+            int x;
+            int y;
+        };
+        std::vector<Placed> placed;
+        int cursor = 0;
+        const FontRender::Glyph *last = NULL;
+        for(size_t i = 0; i < word.text.size();){
+            auto glyph = FontRender::glyph(font, DNK::String::decodeUTF8(word.text, i));
+            cursor += FontRender::kern(font, last, glyph);
+            last = glyph;
+            if(glyph->box.w > 0){
+                placed.push_back(Placed { glyph, cursor + (int)glyph->orig.x, font.avgBearingY - glyph->horBearingY });
+            }
+            cursor += glyph->size.x;
+        }
+        word.width = cursor;
+        word.composited = false;
+        // distance fields are sampled where they land, there's no mask to keep
+        if(placed.size() == 0 || font.source){
+            return;
+        }
+        int x0 = placed[0].x, y0 = placed[0].y, x1 = x0, y1 = y0;
+        for(size_t i = 0; i < placed.size(); ++i){
+            auto &a = placed[i];
+            for(size_t j = 0; j < i; ++j){
+                auto &b = placed[j];
+                if(a.x < b.x + (int)b.glyph->box.w && b.x < a.x + (int)a.glyph->box.w &&
+                    a.y < b.y + (int)b.glyph->box.h && b.y < a.y + (int)a.glyph->box.h){
+                    return;
+                }
+            }
+            x0 = std::min(x0, a.x);
+            y0 = std::min(y0, a.y);
+            x1 = std::max(x1, a.x + (int)a.glyph->box.w);
+            y1 = std::max(y1, a.y + (int)a.glyph->box.h);
+        }
+        // uncovered pixels stay 0, which blends to exactly what was there
+        word.x = x0;
+        word.y = y0;
+        word.w = x1 - x0;
+        word.h = y1 - y0;
+        word.mask.assign(word.w * word.h, 0);
+        for(auto &p : placed){
+            auto glyph = p.glyph;
+            for(unsigned row = 0; row < glyph->box.h; ++row){
+                memcpy(&word.mask[(p.x - x0) + (p.y - y0 + row) * word.w], glyph->pixels + row * glyph->pitch, glyph->box.w);
+            }
+        }
+        word.composited = true;
+    }
+
+    // Entries are shared so an evicted word stays alive for whoever is drawing
+    // it. Composing happens outside the lock, two threads missing on the same
+    // word both compose it and the second insert is dropped
+    static std::shared_ptr<const FontRender::Word> word(FontRender::Font &font, const std::string &text){
+        auto &cache = font.words;
+        {
+            std::lock_guard<std::mutex> guard(cache.lock);
+            auto found = cache.index.find(text);
+            if(found != cache.index.end()){
+                cache.words.splice(cache.words.begin(), cache.words, found->second);
+                return *found->second;
+            }
+        }
+        auto word = std::make_shared<FontRender::Word>();
+        word->text = text;
+        FontRender::compose(font, *word);
+
+        std::lock_guard<std::mutex> guard(cache.lock);
+        if(cache.index.find(text) != cache.index.end()){
+            return word;
+        }
+        if(cache.words.size() >= FontRender::WordCache::CAPACITY){
+            cache.index.erase(cache.words.back()->text);
+            cache.words.pop_back();
+        }
+        cache.words.push_front(word);
+        cache.index[text] = cache.words.begin();
+        return word;
+    }
+
+    unsigned getWidth(FontRender::Font &font, const std::string &word){
+        return FontRender::word(font, word)->width;
+    }
+
+    void renderWord(FontRender::Font &font, const std::string &text, const DNK::Vec2<unsigned> &pos, const DNK::Color &color, DNK::Bitmap *target){
+        auto word = FontRender::word(font, text);
+        if(!word->composited){
+            FontRender::render(font, text, pos, color, target);
+            return;
+        }
+        target->pasteMask(word->mask.data(), word->w, word->w, word->h, (int)pos.x + word->x, (int)pos.y + word->y, color);
+    }
+}
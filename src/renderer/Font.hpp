@@ -0,0 +1,403 @@
+#ifndef DNK_FONT_HPP
+    #define DNK_FONT_HPP
+
+    #include <list>
+    #include <mutex>
+    #include <atomic>
+    #include <ft2build.h>
+    #include <freetype/freetype.h>
+    #include FT_FREETYPE_H
+    #include FT_SIZES_H
+    #include FT_SYNTHESIS_H
+
+    #include "../dinky.hpp"
+    #include "../common/Tools.hpp"
+    #include "../common/Bitmap.hpp"
+
+    namespace FontRender {
+
+        namespace GlyphMode {
+            enum GlyphMode : unsigned {
+                COVERAGE,   // 8-bit antialiased coverage (FT_RENDER_MODE_NORMAL)
+                SDF         // 8-bit signed distance to the outline, 128 on the edge
+            };
+        }
+
+        // Weights drawn from one face. BOLD thickens the regular outlines
+        // (FT_GlyphSlot_Embolden), so a family needs a single file
+        namespace FontWeight {
+            enum FontWeight : unsigned {
+                REGULAR,
+                BOLD
+            };
+        }
+
+        // Distance fields are rasterized once at SDF_SIZE and reach SDF_SPREAD
+        // pixels (at that size) out of and into the outline
+        static const unsigned SDF_SIZE = 64;
+        static const unsigned SDF_SPREAD = 8;
+
+        // Printable ASCII and Latin-1, what gets baked and kerned at build time
+        inline bool isCommon(unsigned codepoint){
+            return (codepoint >= 32 && codepoint < 127) || (codepoint >= 160 && codepoint < 256);
+        }
+
+        // Left to right shelves over a `width` wide area
+        struct Shelves {
+            unsigned width;
+            unsigned x;
+            unsigned y;
+            unsigned height;
+
+            Shelves(){
+                reset(0);
+            }
+
+            void reset(unsigned width){
+                this->width = width;
+                this->x = 0;
+                this->y = 0;
+                this->height = 0;
+            }
+
+            // one pixel gap so neighbours never bleed into each other
+            void place(unsigned w, unsigned h, unsigned &px, unsigned &py){
+                if(this->x + w > this->width){
+                    this->y += this->height + 1;
+                    this->x = 0;
+                    this->height = 0;
+                }
+                px = this->x;
+                py = this->y;
+                this->x += w + 1;
+                this->height = std::max(this->height, h);
+            }
+        };
+
+        // 8-bit coverage of the glyphs rasterized in this process, in pages that
+        // never move or go away while the font lives. Glyphs point straight into
+        // them so drawing needs no lock; adding needs Font::lock
+        struct Atlas {
+            std::vector<std::unique_ptr<uint8[]>> pages;
+            unsigned width;
+            unsigned pageHeight;
+            FontRender::Shelves shelves;
+
+            Atlas(){
+                init(0, 0);
+            }
+
+            void init(unsigned width, unsigned pageHeight){
+                this->pages.clear();
+                this->width = width;
+                this->pageHeight = pageHeight;
+                this->shelves.reset(width);
+            }
+
+            // where the copy went, NULL for an empty or oversized glyph
+            const uint8 *add(unsigned w, unsigned h, const unsigned char *src, int pitch){
+                if(w == 0 || h == 0){
+                    return NULL;
+                }
+                if(w > this->width || h > this->pageHeight){
+                    fprintf(stderr, "Font::Atlas::add: Glyph (%ux%upx) is bigger than an atlas page (%ux%upx)\n", w, h, this->width, this->pageHeight);
+                    return NULL;
+                }
+                unsigned x, y;
+                this->shelves.place(w, h, x, y);
+                if(this->pages.size() == 0 || y + h > this->pageHeight){
+                    this->pages.emplace_back(new uint8[this->width * this->pageHeight]());
+                    this->shelves.reset(this->width);
+                    this->shelves.place(w, h, x, y);
+                }
+                auto dst = this->pages.back().get() + x + y * this->width;
+                for(unsigned row = 0; row < h; ++row){
+                    memcpy(dst + row * this->width, src + row * pitch, w);
+                }
+                return dst;
+            }
+        };
+
+        struct Glyph {
+            DNK::Rect<unsigned> box; // w x h of coverage at `pixels`, empty for blank glyphs
+            const uint8 *pixels;     // in an atlas page, the glyph cache mapping or the baked tables
+            unsigned pitch;
+            unsigned glyph;
+            int horBearingY;
+            int avgBearingY;
+            DNK::Vec2<float> coors;
+            DNK::Vec2<float> size;
+            DNK::Vec2<float> orig;
+            DNK::Vec2<float> index;
+            int symbol;
+        };
+
+        // Codepoint to glyph in one indexed load. ASCII and Latin-1 are a flat
+        // array, anything above goes through 256-entry pages made on demand.
+        // NULL means the codepoint wasn't asked for yet. get() takes no lock, set()
+        // needs Font::lock and publishes a finished glyph
+        struct GlyphTable {
+            static const unsigned PAGES = 0x110000 >> 8;
+            std::atomic<FontRender::Glyph*> latin[256];
+            std::atomic<std::atomic<FontRender::Glyph*>*> pages[PAGES];
+
+            GlyphTable(){
+                for(unsigned i = 0; i < 256; ++i){
+                    latin[i].store(NULL, std::memory_order_relaxed);
+                }
+                for(unsigned i = 0; i < PAGES; ++i){
+                    pages[i].store(NULL, std::memory_order_relaxed);
+                }
+            }
+
+            ~GlyphTable(){
+                for(unsigned i = 0; i < PAGES; ++i){
+                    delete[] pages[i].load(std::memory_order_relaxed);
+                }
+            }
+
+            void set(unsigned codepoint, FontRender::Glyph *glyph){
+                if(codepoint < 256){
+                    latin[codepoint].store(glyph, std::memory_order_release);
+                    return;
+                }
+                auto page = pages[codepoint >> 8].load(std::memory_order_acquire);
+                if(page == NULL){
+                    page = new std::atomic<FontRender::Glyph*>[256]();
+                    pages[codepoint >> 8].store(page, std::memory_order_release);
+                }
+                page[codepoint & 0xFF].store(glyph, std::memory_order_release);
+            }
+
+            FontRender::Glyph *get(unsigned codepoint) const {
+                if(codepoint < 256){
+                    return latin[codepoint].load(std::memory_order_acquire);
+                }
+                auto page = pages[codepoint >> 8].load(std::memory_order_acquire);
+                return page != NULL ? page[codepoint & 0xFF].load(std::memory_order_acquire) : NULL;
+            }
+        };
+
+        // One resolved codepoint as the glyph cache and the baked fonts keep it,
+        // x and y into their atlas. Codepoints sharing a FreeType index share a
+        // glyph again once adopted
+        struct GlyphRecord {
+            uint32 codepoint;
+            uint32 index;
+            uint32 x, y, w, h;
+            int32 origX;
+            int32 origY;
+            int32 horBearingY;
+            float sizeX;
+            float sizeY;
+            uint32 reserved;
+        };
+
+        // Kerning between two glyphs, sorted by `pair` (left index << 16 | right
+        // index, TrueType indices are 16-bit). Every font holds the nonzero pairs of
+        // the common range from its load, glyph caches add every other pair asked
+        // so far, zeros included
+        struct KernPair {
+            uint32 pair;
+            int32 x;
+        };
+
+        // A font size rasterized at build time by dinky_bake, compiled in as tables
+        struct BakedFont {
+            uint64 hash;            // DNK::Hash::bytes of the font file
+            unsigned size;
+            unsigned mode;
+            unsigned weight;
+            int vertAdvance;
+            unsigned advanceX;
+            int horiBearingY;
+            int avgBearingY;
+            unsigned width;
+            unsigned height;
+            const FontRender::GlyphRecord *glyphs;
+            unsigned count;
+            const uint8 *pixels;
+            const FontRender::KernPair *kerning;
+            unsigned kernCount;
+            bool kerns;             // the face has a kerning table
+        };
+
+        // Every glyph looked up so far in one contiguous atlas, as stored
+        struct Packed {
+            unsigned width;
+            unsigned height;
+            std::vector<uint8> pixels;
+            std::vector<FontRender::GlyphRecord> records;
+            std::vector<FontRender::KernPair> kerning;
+        };
+
+        // A word laid out once: its advance and, when none of its glyphs overlap,
+        // their coverage composited into one mask so drawing it is one blit
+        struct Word {
+            std::string text;
+            unsigned width;
+            int x;                  // mask origin from the pen, y from the line top
+            int y;
+            unsigned w;
+            unsigned h;
+            bool composited;        // false: glyphs overlap or none has ink, draw them one by one
+            std::vector<uint8> mask;
+        };
+
+        // Most recently used words of one font size, front is the newest. Entries
+        // are shared so an eviction can't pull one from under a thread drawing it
+        struct WordCache {
+            static const size_t CAPACITY = 2048;
+            std::mutex lock;
+            std::list<std::shared_ptr<const FontRender::Word>> words;
+            std::unordered_map<std::string, std::list<std::shared_ptr<const FontRender::Word>>::iterator> index;
+        };
+
+        struct Registry;
+
+        // A font file opened once for every size of it. Each size has its own
+        // FT_Size and activates it under `lock` before touching the face
+        struct Face {
+            FT_Face face;
+            std::mutex lock;
+
+            Face(){
+                face = NULL;
+            }
+        };
+
+        // Glyphs are rasterized the first time a codepoint shows up. The face is
+        // only opened then, a font read back from the glyph cache may never need it.
+        // An SDF font of any size has no face or atlas of its own: its glyphs are
+        // `source`'s, the field of its face at SDF_SIZE, with metrics scaled down.
+        // Once published the metrics, `kerning` and `common` don't change, so a pair
+        // of two common glyphs is answered without a lock. Other pairs missing from
+        // `kerning` are asked of the face when first drawn and kept in `kerned`
+        struct Font {
+            std::string name;
+            std::string filename;
+            std::mutex lock;    // a miss: the face, the atlas and `map`
+            std::unordered_map<unsigned, std::shared_ptr<Glyph>> map; // owns the glyphs, by FreeType index
+            FontRender::GlyphTable table;
+            FontRender::Atlas atlas;
+            FontRender::WordCache words;
+            std::vector<FontRender::KernPair> kerning; // built at load, or from the baked tables or the glyph cache
+            std::vector<uint32> common;                // sorted indices of the common codepoints' glyphs
+            std::unordered_map<uint32, int32> kerned;  // under `lock`, pairs asked since
+            bool kerns;         // the face has a kerning table, no pair is asked otherwise
+            std::shared_ptr<DNK::File::View> storage; // glyph cache file the glyphs point into
+            FontRender::Registry *registry;
+            FontRender::Face *face; // shared with the other sizes of the file, NULL until a glyph needs it
+            FT_Size faceSize;
+            bool failed;        // the face couldn't be opened, don't try again
+            uint64 hash;        // DNK::Hash::bytes of the font file
+            unsigned mode;
+            unsigned weight;
+            std::string cache;  // glyph cache file, empty when not caching or baked
+            std::atomic<bool> dirty; // glyphs were added since the cache was read
+            std::shared_ptr<FontRender::Font> source;
+            float scale;        // size / source->size
+            int vertAdvance;
+            unsigned advanceX;
+            int horiBearingY;
+            int avgBearingY;
+            unsigned size;
+
+            Font(){
+                registry = NULL;
+                face = NULL;
+                faceSize = NULL;
+                failed = false;
+                kerns = false;
+                hash = 0;
+                mode = FontRender::GlyphMode::COVERAGE;
+                weight = FontRender::FontWeight::REGULAR;
+                dirty = false;
+                scale = 1.0f;
+                vertAdvance = 0;
+                advanceX = 0;
+                horiBearingY = 0;
+                avgBearingY = 0;
+                size = 0;
+            }
+
+            ~Font(){
+                if(faceSize != NULL){
+                    FT_Done_Size(faceSize);
+                }
+            }
+        };
+
+        // Fonts by name for any number of threads. Lookups walk a list that is only
+        // ever prepended to and take no lock. Loads, and opening faces on the one
+        // FT_Library (FreeType wants FT_New_Face serialized), go one at a time.
+        // Font files are mapped once and faces read them from memory, so workers
+        // running the same fonts share them through the page cache
+        struct Registry {
+            struct Entry {
+                std::string name;
+                std::shared_ptr<FontRender::Font> font;
+                Entry *next;
+            };
+            std::atomic<Entry*> head;
+            std::mutex lock;
+            FT_Library library; // started with the first face that's opened
+            std::unordered_map<std::string, std::shared_ptr<DNK::File::View>> files;
+            std::unordered_map<std::string, std::unique_ptr<FontRender::Face>> faces;
+            std::unordered_map<std::string, uint64> hashes; // DNK::Hash::bytes of each file, for the baked sizes and the glyph cache
+
+            Registry();
+            ~Registry();
+
+            // Both need `lock`, NULL when the file can't be mapped or opened
+            std::shared_ptr<DNK::File::View> file(const std::string &filename);
+            FontRender::Face *face(const std::string &filename);
+
+            // a name already loaded with the same file, size, mode and weight is left as is
+            bool load(const std::string &name, const std::string &filename, unsigned size, const std::string &cacheDir, unsigned mode, unsigned weight);
+            FontRender::Font *find(const std::string &name) const;
+            void flush();
+        };
+
+        // The process' registry, the functions below go through it
+        FontRender::Registry &registry();
+
+        // `cacheDir` empty loads without the glyph cache. SDF sizes of one file share
+        // a single field font, so only the first one rasterizes anything
+        bool load(const std::string &name, const std::string &filename, unsigned size, const std::string &cacheDir = "", unsigned mode = FontRender::GlyphMode::COVERAGE,
+            unsigned weight = FontRender::FontWeight::REGULAR);
+        FontRender::Font *find(const std::string &name);
+        // writes the glyph cache of every font that rasterized something new
+        void flush();
+        FontRender::Glyph *glyph(FontRender::Font &font, unsigned codepoint);
+        void render(FontRender::Font &font, const std::string &text, const DNK::Vec2<unsigned> &pos, const DNK::Color &color, DNK::Bitmap *target);
+        DNK::Vec2<unsigned> getDimensions(FontRender::Font &font, const std::string &text);
+        // Same results as getDimensions().x and render() for one word, through the word cache
+        unsigned getWidth(FontRender::Font &font, const std::string &word);
+        void renderWord(FontRender::Font &font, const std::string &word, const DNK::Vec2<unsigned> &pos, const DNK::Color &color, DNK::Bitmap *target);
+
+        // glyph sets smaller than this rasterize faster on one thread
+        static const size_t PARALLEL_MIN = 64;
+
+        // Rasterizes the glyphs of `codepoints` that aren't in `font` yet, on up to
+        // `threads` threads with a face each, and adds them to the atlas in glyph order
+        void preload(FontRender::Font &font, const std::vector<unsigned> &codepoints, unsigned threads);
+
+        // Every codepoint looked up so far packed `font.atlas.width` wide with every
+        // kerning pair known, and the way back into a font for glyphs whose pixels
+        // live `width` wide at `pixels`
+        void pack(FontRender::Font &font, FontRender::Packed &out);
+        void adopt(FontRender::Font &font, const FontRender::GlyphRecord *records, size_t count, const uint8 *pixels, unsigned width);
+
+        // Defined by the generated BakedFonts.cpp, NULL when that file (by content hash),
+        // size and weight weren't baked
+        const FontRender::BakedFont *findBaked(uint64 hash, unsigned size, unsigned mode, unsigned weight);
+
+        // Glyph cache (.dnkg): atlas, glyph records and metrics of one font size,
+        // keyed by font file hash, size, mode and weight. See renderer/GlyphCache.cpp
+        std::string cachePath(const std::string &dir, uint64 hash, unsigned size, unsigned mode, unsigned weight);
+        bool readCache(FontRender::Font &font, const std::string &path);
+        bool writeCache(FontRender::Font &font, const std::string &path);
+    }
+
+#endif
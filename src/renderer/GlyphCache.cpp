@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/Tools.hpp"
+#include "Font.hpp"
+
+/*
+    .dnkg layout, one file per font file hash, pixel size, glyph mode and weight:
+
+        Header   metrics
+        glyphs   GlyphRecord[], one per codepoint already looked up
+        kerning  KernPair[], sorted, the common range's and every pair asked so far
+        common   uint32[], sorted glyph indices of the common codepoints
+        atlas    width * height bytes of coverage, every glyph packed once
+
+    Like .dnkc, sections are 8-byte aligned, offsets are from the start of the
+    file and `order` rejects files from another endianness. A hit is one map
+    and a record walk, glyphs draw straight from the mapping the font keeps
+    and FreeType isn't started until a codepoint that isn't in the file shows up
+*/
+namespace GlyphCache {
+
+    static const char MAGIC[4] = { 'D', 'N', 'K', 'G' };
+    static const uint32 VERSION = 7;
+    static const uint32 ORDER = 0x01020304;
+
+    struct Header {
+        char magic[4];
+        uint32 version;
+        uint32 order;
+        uint32 size;
+        uint64 hash;
+        uint32 mode;
+        uint32 weight;
+        uint32 record;          // sizeof(GlyphRecord)
+        uint32 kerns;           // the face has a kerning table
+        int32 vertAdvance;
+        uint32 advanceX;
+        int32 horiBearingY;
+        int32 avgBearingY;
+        uint32 width;
+        uint32 height;
+        uint64 glyphs;          // offset of the records
+        uint64 count;
+        uint64 kerning;         // offset of the kerning pairs
+        uint64 kernCount;
+        uint64 common;          // offset of the common glyph indices
+        uint64 commonCount;
+        uint64 atlas;           // offset of the pixels
+    };
+
+    static uint64 align(uint64 offset){
+        return (offset + 7) & ~7ULL;
+    }
+
+}
+
+std::string FontRender::cachePath(const std::string &dir, uint64 hash, unsigned size, unsigned mode, unsigned weight){
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx-%u-%u-%u.dnkg", static_cast<unsigned long long>(hash), size, mode, weight);
+    return dir + DNK::File::dirSep() + name;
+}
+
+bool FontRender::writeCache(FontRender::Font &font, const std::string &path){
+    FontRender::Packed packed;
+    FontRender::pack(font, packed);
+    auto &records = packed.records;
+
+    GlyphCache::Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GlyphCache::MAGIC, sizeof(header.magic));
+    header.version = GlyphCache::VERSION;
+    header.order = GlyphCache::ORDER;
+    header.size = font.size;
+    header.hash = font.hash;
+    header.mode = font.mode;
+    header.weight = font.weight;
+    header.record = sizeof(FontRender::GlyphRecord);
+    header.vertAdvance = font.vertAdvance;
+    header.advanceX = font.advanceX;
+    header.horiBearingY = font.horiBearingY;
+    header.avgBearingY = font.avgBearingY;
+    header.width = packed.width;
+    header.height = packed.height;
+    header.glyphs = GlyphCache::align(sizeof(header));
+    header.count = records.size();
+    header.kerning = GlyphCache::align(header.glyphs + records.size() * sizeof(FontRender::GlyphRecord));
+    header.kerns = font.kerns;
+    header.kernCount = packed.kerning.size();
+    header.common = GlyphCache::align(header.kerning + packed.kerning.size() * sizeof(FontRender::KernPair));
+    header.commonCount = font.common.size();
+    header.atlas = GlyphCache::align(header.common + font.common.size() * sizeof(uint32));
+
+    // written aside and renamed so readers never map a half written file
+    auto tmp = path + "." + std::to_string(getpid()) + ".part";
+    auto file = fopen(tmp.c_str(), "wb");
+    if(file == NULL){
+        fprintf(stderr, "Font::writeCache: Failed to create '%s'\n", tmp.c_str());
+        return false;
+    }
+    static const char zeros[8] = { 0 };
+    const void *parts[] = { records.data(), packed.kerning.data(), font.common.data(), packed.pixels.data() };
+    uint64 offsets[] = { header.glyphs, header.kerning, header.common, header.atlas };
+    uint64 sizes[] = {
+        records.size() * sizeof(FontRender::GlyphRecord), packed.kerning.size() * sizeof(FontRender::KernPair),
+        font.common.size() * sizeof(uint32), packed.pixels.size()
+    };
+    auto ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64 written = sizeof(header);
+    for(unsigned i = 0; ok && i < 4; ++i){
+        auto pad = offsets[i] - written;
+        ok = fwrite(zeros, 1, pad, file) == pad && (sizes[i] == 0 || fwrite(parts[i], 1, sizes[i], file) == sizes[i]);
+        written += pad + sizes[i];
+    }
+    ok = fclose(file) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0){
+        fprintf(stderr, "Font::writeCache: Failed to write '%s'\n", path.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FontRender::readCache(FontRender::Font &font, const std::string &path){
+    if(!DNK::File::exists(path)){
+        return false;
+    }
+    auto view = DNK::File::map(path);
+    if(!view){
+        return false;
+    }
+    GlyphCache::Header header;
+    if(view->size < sizeof(header)){
+        fprintf(stderr, "Font::readCache: '%s' is truncated\n", path.c_str());
+        return false;
+    }
+    memcpy(&header, view->data, sizeof(header));
+    if(memcmp(header.magic, GlyphCache::MAGIC, sizeof(header.magic)) != 0 || header.version != GlyphCache::VERSION ||
+        header.order != GlyphCache::ORDER || header.record != sizeof(FontRender::GlyphRecord) ||
+        header.hash != font.hash || header.size != font.size || header.mode != font.mode || header.weight != font.weight){
+        fprintf(stderr, "Font::readCache: '%s' is stale or from another build, ignoring it\n", path.c_str());
+        return false;
+    }
+    auto pixels = static_cast<uint64>(header.width) * header.height;
+    if(header.glyphs > view->size || header.count > (view->size - header.glyphs) / sizeof(FontRender::GlyphRecord) ||
+        header.kerning > view->size || header.kernCount > (view->size - header.kerning) / sizeof(FontRender::KernPair) ||
+        header.common > view->size || header.commonCount > (view->size - header.common) / sizeof(uint32) ||
+        header.atlas > view->size || pixels > view->size - header.atlas){
+        fprintf(stderr, "Font::readCache: '%s' is truncated\n", path.c_str());
+        return false;
+    }
+    std::vector<FontRender::GlyphRecord> records(header.count);
+    if(header.count > 0){
+        memcpy(records.data(), view->data + header.glyphs, header.count * sizeof(FontRender::GlyphRecord));
+    }
+    // subtracted rather than added, a huge x or w can't wrap around past the check
+    for(auto &record : records){
+        if(record.codepoint > 0x10FFFF || (record.w > 0 && (record.x > header.width || record.w > header.width - record.x ||
+            record.y > header.height || record.h > header.height - record.y))){
+            fprintf(stderr, "Font::readCache: '%s' is corrupt\n", path.c_str());
+            return false;
+        }
+    }
+    // kern() looks pairs and common glyphs up by binary search
+    std::vector<FontRender::KernPair> kerning(header.kernCount);
+    if(header.kernCount > 0){
+        memcpy(kerning.data(), view->data + header.kerning, header.kernCount * sizeof(FontRender::KernPair));
+    }
+    std::vector<uint32> common(header.commonCount);
+    if(header.commonCount > 0){
+        memcpy(common.data(), view->data + header.common, header.commonCount * sizeof(uint32));
+    }
+    auto byPair = [](const FontRender::KernPair &a, const FontRender::KernPair &b){
+        return a.pair < b.pair;
+    };
+    if(!std::is_sorted(kerning.begin(), kerning.end(), byPair) || !std::is_sorted(common.begin(), common.end())){
+        fprintf(stderr, "Font::readCache: '%s' is corrupt\n", path.c_str());
+        return false;
+    }
+
+    // glyphs point into the mapping, so it lives as long as the font
+    font.storage = view;
+    font.vertAdvance = header.vertAdvance;
+    font.advanceX = header.advanceX;
+    font.horiBearingY = header.horiBearingY;
+    font.avgBearingY = header.avgBearingY;
+    FontRender::adopt(font, records.data(), records.size(), reinterpret_cast<const uint8*>(view->data) + header.atlas, header.width);
+    font.kerning = std::move(kerning);
+    font.common = std::move(common);
+    font.kerns = header.kerns != 0;
+    font.dirty = false;
+    return true;
+}
@@ -1,199 +1,16 @@
+#include <algorithm>
 #include <cmath>
-
-#include <ft2build.h>
-#include <freetype/freetype.h>
-#include <freetype/ftglyph.h>
-#include <freetype/ftstroke.h>
-#include FT_FREETYPE_H
+#include <unordered_map>
 
 #include "../dinky.hpp"
 #include "../common/Tools.hpp"
 #include "../common/Bitmap.hpp"
-
-#define ENCODING_ASCII_RANGE_MIN 32
-#define ENCODING_ASCII_RANGE_MAX 128
+#include "Font.hpp"
+#include "TextStyle.hpp"
 
 // width 215.9
 // height 279.4
 
-namespace FontRender {
-    
-    struct Glyph {
-        DNK::Bitmap bmp;
-        unsigned glyph;
-        int horBearingY;
-        int avgBearingY;
-        DNK::Vec2<float> coors;
-        DNK::Vec2<float> size;
-        DNK::Vec2<float> orig;
-        DNK::Vec2<float> index;       
-        int symbol; 
-
-        void solid(int w, int h, unsigned char* src){
-            int channels = 4; 
-            auto bsize = w * h * channels;
-            unsigned char *buffer = new unsigned char[bsize];
-            memset(buffer, 0, bsize);
-            for(int i = 0; i < w*h; ++i){
-                buffer[i*4 + 0] = src[i];
-                buffer[i*4 + 1] = src[i];
-                buffer[i*4 + 2] = src[i];
-                buffer[i*4 + 3] = src[i];
-            }
-            this->bmp.load(w, h, 4, buffer);
-            delete buffer;
-        }           
-    };
-
-    struct Font {
-        std::string name;
-        std::unordered_map<unsigned, std::shared_ptr<Glyph>> map;
-        std::unordered_map<unsigned, unsigned> ASCIITrans;
-        int vertAdvance;
-        unsigned advanceX;
-        int horiBearingY;
-        int avgBearingY;
-        unsigned size;
-    };
-
-    static std::unordered_map<std::string, std::shared_ptr<FontRender::Font>> fonts;
-
-    bool load(const std::string &name, const std::string &filename, unsigned size){
-
-        if(!DNK::File::exists(filename)){
-            fprintf(stderr, "Font::load: Failed to load font '%s': It doesn't exist\n",  filename.c_str());
-            return false;
-        }
-
-
-        auto font = std::make_shared<FontRender::Font>();
-        font->name = name;
-        font->size = size;
-
-        FT_Library library; 
-        FT_Face face;
-        FT_Stroker stroker;
-
-
-        if(FT_Init_FreeType(&library)){
-            fprintf(stderr, "Font::load: Failed to start FreeType: FT_Init_FreeType\n");
-            return false;
-        }
-
-        if(FT_New_Face(library, filename.c_str(), 0, &face)) {
-            fprintf(stderr, "Font::genMapping: Failed loading font '%s: FT_New_Face\n", filename.c_str());
-            return false;
-        }	
-
-        if(FT_Set_Char_Size(face, 0, size << 6, 96, 96)){
-            fprintf(stderr, "Font::genMapping: Failed loading font '%s': FT_Set_Char_Size\n", filename.c_str());	
-            return false;
-        }
-        std::vector<FT_UInt> mapping;
-
-
-        for(unsigned i = ENCODING_ASCII_RANGE_MIN; i < ENCODING_ASCII_RANGE_MAX; ++i){
-            auto cindex = FT_Get_Char_Index(face, i);
-            mapping.push_back(cindex);
-            font->ASCIITrans[i] = cindex;
-        }
-
-        unsigned maxHeight = 0;
-        FT_Stroker_New(library, &stroker);
-        FT_Stroker_Set(stroker, (int)(2.0f * 64.0f), FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);        
-
-        font->vertAdvance = face->size->metrics.height >> 6;
-        font->advanceX = face->glyph->advance.x >> 6;
-        font->horiBearingY = face->glyph->metrics.horiBearingY >> 6;
-
-        for(unsigned i = 0; i < mapping.size(); ++i){
-            FT_Glyph glyph, stroke;
-            std::shared_ptr<Glyph> sg = std::make_shared<Glyph>();
-            auto id = mapping[i];
-            sg->symbol = i;
-            // Load glyph
-            if(FT_Load_Glyph(face, id, FT_LOAD_DEFAULT)){
-                fprintf(stderr, "Font::genMapping: Failed to load glyph '%c' for font '%s'\n", (char)i, filename.c_str());
-                continue;
-            }
-            // Get base glyph
-            if(FT_Get_Glyph(face->glyph, &glyph)){
-                fprintf(stderr, "Font::genMapping: Failed to load glyph '%c' for font '%s'\n", (char)i, filename.c_str());
-                continue;
-            }     
-            // Get stroke glyph
-            if(FT_Get_Glyph(face->glyph, &stroke)){
-                fprintf(stderr, "Font::genMapping: Failed to load glyph '%c' for font '%s'\n", (char)i, filename.c_str());
-                continue;
-            }             
-            FT_Glyph_StrokeBorder(&stroke, stroker, 0, 1);
-            font->map[id] = sg;
-
-
-            FT_Glyph_To_Bitmap(&glyph, FT_RENDER_MODE_NORMAL, NULL, true);
-            FT_BitmapGlyph bitmap = reinterpret_cast<FT_BitmapGlyph>(glyph);
-            sg->solid(bitmap->bitmap.width, bitmap->bitmap.rows, bitmap->bitmap.buffer);
-            sg->orig.x = bitmap->left;
-            sg->orig.y = bitmap->top;
-            sg->size.x = std::max((float)(face->glyph->advance.x >> 6), (float)bitmap->bitmap.width);
-            sg->size.y = std::max((float)(face->glyph->advance.y >> 6), (float)bitmap->bitmap.rows);
-            sg->horBearingY = face->glyph->metrics.horiBearingY >> 6;
-
-            FT_Done_Glyph(glyph);
-            FT_Done_Glyph(stroke);
-        }
-
-        for(auto &it : font->map){
-            font->avgBearingY = std::max((float)font->avgBearingY, (float)it.second->horBearingY);
-        }
-
-
-        FT_Stroker_Done(stroker);
-        FT_Done_Face(face);
-        FT_Done_FreeType(library);
-
-        printf("Font: loaded '%s' (%ipx)\n", filename.c_str(), size);
-
-        fonts[name] = font;
-
-        return true;
-    }
-
-    bool render(const std::string &name, const std::string &text, const DNK::Vec2<unsigned> &pos, const DNK::Color &color, DNK::Bitmap *target){
-        if(fonts.count(name) == 0){
-            fprintf(stderr, "Font::render: Failed to find font '%s'\n", name.c_str());
-            return false;
-        }
-        auto &font = fonts[name];
-        DNK::Vec2<int> cursor { 0 , 0 };
-        for(int i = 0; i < text.size(); ++i){
-			char current =  text[i];
-            auto &glyph = font->map[font->ASCIITrans[current]];
-            auto p = pos + DNK::Vec2<unsigned>(cursor.x + glyph->orig.x, cursor.y + (- glyph->horBearingY) + font->avgBearingY);
-            target->pasteAndShade(&glyph->bmp, p.x, p.y, color);
-            cursor.x += glyph->size.x;
-        }
-        return true;
-    }
-
-    DNK::Vec2<unsigned> getDimensions(const std::string &name, const std::string &text){
-        DNK::Vec2<unsigned> dims(0);
-        if(fonts.count(name) == 0){
-            fprintf(stderr, "Font::render: Failed to find font '%s'\n", name.c_str());
-            return dims;
-        }
-        auto &font = fonts[name];
-        dims.y = font->avgBearingY;
-        for(int i = 0; i < text.size(); ++i){
-			char current =  text[i];
-            auto &glyph = font->map[font->ASCIITrans[current]];
-            dims.x += glyph->size.x;
-        }        
-        return dims;
-    }
-}
-
-
 namespace Shape {
 
     void Line(int x1, int y1, int x2, int y2, const DNK::Color &color, DNK::Bitmap &target){
@@ -213,7 +30,12 @@ namespace Shape {
             if(x < 0 || x >= target.width || y < 0 || y >= target.height){
                 return;
             }                   
-            target.pixels[x + y * target.width] = color;
+            // a flat line is a single span
+            if(dy == 0){
+                target.fillSpan(x, y, std::min(xe, (int)target.width - 1) - x + 1, color);
+                return;
+            }
+            target.set(x, y, color);
             for (i = 0; x<xe; i++){
                 x = x + 1;
                 if (px<0){
@@ -229,7 +51,7 @@ namespace Shape {
                 if(x < 0 || x >= target.width || y < 0 || y >= target.height){
                     continue;
                 }              
-                target.pixels[x + y * target.width] = color;
+                target.set(x, y, color);
             }
         }else{
             if (dy >= 0){
@@ -244,7 +66,7 @@ namespace Shape {
             if(x < 0 || x >= target.width || y < 0 || y >= target.height){
                 return;
             }               
-            target.pixels[x + y * target.width] = color;
+            target.set(x, y, color);
             for (i = 0; y<ye; i++){
                 y = y + 1;
                 if (py <= 0){
@@ -260,7 +82,7 @@ namespace Shape {
                 if(x < 0 || x >= target.width || y < 0 || y >= target.height){
                     continue;
                 }                  
-                target.pixels[x + y * target.width] = color;
+                target.set(x, y, color);
             }
         }
 
@@ -278,16 +100,9 @@ namespace Shape {
     }
 
     void FilledRect(int x, int y, int w, int h, const DNK::Color &color, DNK::Bitmap &target){
-        for(int xi = 0; xi < w; ++xi){
-            for(int yi = 0; yi < h; ++yi){
-                int fx = x+xi;
-                int fy = y+yi;
-                if(fx < 0 || fx >= target.width || fy < 0 || fy >= target.height){
-                    continue;
-                }
-                int index = (fx) + (fy) * target.width;
-                target.pixels[index] = color;
-            }
+        auto r = target.clip(x, y, w, h);
+        for(unsigned yi = 0; yi < r.h; ++yi){
+            target.fillSpan(r.x, r.y + yi, r.w, color);
         }
     }
 
@@ -308,37 +123,86 @@ namespace Shape {
     }
 
 
-    void FilledCircle(int x, int y, int r, int verts, const DNK::Color &color, DNK::Bitmap &target){
+    void FilledCircle(int x, int y, int r, const DNK::Color &color, DNK::Bitmap &target){
+        auto inside = [&](int fx, int fy){
+            return DNK::Math::sqrt(fx*fx + fy*fy) <= r;
+        };
         int d = r * 2;
-        for(int xi = 0; xi < d; ++xi){
-            for(int yi = 0; yi < d; ++yi){
-                int fx = xi - r;
-                int fy = yi - r;
-                auto mod = DNK::Math::sqrt(fx*fx + fy*fy);
-                if(mod <= r){
-                    int _x = xi + x;
-                    int _y = yi + y;
-                    if(_x < 0 || _x >= target.width || _y < 0 || _y >= target.height){
-                        continue;
-                    }
-                    int index = (_x) + (_y) * target.width;
-                    target.pixels[index] = color;
-                }
+        for(int yi = 0; yi < d; ++yi){
+            int fy = yi - r;
+            if(!inside(0, fy)){
+                continue;
             }
+            // the row is the run of offsets -k..k the test accepts, k starts from
+            // the estimate and is settled with the same test the pixels used to get
+            int k = (int)DNK::Math::sqrt(r*r - fy*fy);
+            while(k < r && inside(k + 1, fy)){
+                ++k;
+            }
+            while(k > 0 && !inside(k, fy)){
+                --k;
+            }
+            // offsets stop at r - 1 on the right
+            int x0 = x + r - k;
+            int x1 = x + r + std::min(k, r - 1);
+            auto span = target.clip(x0, y + yi, x1 - x0 + 1, 1);
+            target.fillSpan(span.x, span.y, span.w, color);
         }
-    }    
-    
+    }
+
+}
+
+// what nodes draw in which style, the styles themselves are in TextStyle.hpp
+namespace TextStyle {
+    // COUNT for nodes that draw no text
+    static unsigned of(const DNK::Document &doc, uint32 index){
+        switch(doc.arena.nodes[index].type){
+            case DNK::NodeType::TEXT: {
+                return doc.getBoolStyle(index, DNK::AttributeKey::BOLD) ? TextStyle::BOLD : TextStyle::BODY;
+            };
+            case DNK::NodeType::TITLE: {
+                return TextStyle::TITLE;
+            };
+            case DNK::NodeType::SUBTITLE: {
+                return TextStyle::SUBTITLE;
+            };
+            case DNK::NodeType::CARDVIDEO: {
+                return TextStyle::CAPTION;
+            };
+            default: {
+                return TextStyle::COUNT;
+            };
+        }
+    }
+
+    // headings are written as [%title v:'...'%], a card's caption is its v: or src:
+    static std::string text(const DNK::Document &doc, uint32 index){
+        auto type = doc.arena.nodes[index].type;
+        if(type == DNK::NodeType::TEXT){
+            return doc.getText(index);
+        }
+        if(doc.getParam(index, DNK::AttributeKey::VALUE) != NULL){
+            return doc.getStringParam(index, DNK::AttributeKey::VALUE);
+        }
+        if(type == DNK::NodeType::CARDVIDEO){
+            return doc.getStringParam(index, DNK::AttributeKey::SOURCE);
+        }
+        return doc.getText(index);
+    }
 }
 
 struct DocumentHandle {
     DNK::Vec2<int> cursor;
     DNK::Color color;
     DNK::Vec2<int> minSize;
-    std::string currentFont;
+    FontRender::Font *fonts[TextStyle::COUNT]; // NULL for styles the document doesn't use
+    std::unordered_map<uint32, std::string> texts; // TextStyle::text of every node drawn with text
     int pixelSize;
 
     DocumentHandle(){
-        currentFont = "default";
+        for(unsigned i = 0; i < TextStyle::COUNT; ++i){
+            fonts[i] = NULL;
+        }
         cursor.set(0);
         color.set(0.0f, 0.0f, 0.0f, 1.0f);
     }
@@ -359,23 +223,24 @@ struct RenderProduct {
     }
 };
 
-static RenderProduct render(const std::shared_ptr<DNK::Node> &node, DNK::Node *head, int wideSpace, DocumentHandle &handle){
+static RenderProduct render(const DNK::Document &doc, uint32 index, int wideSpace, DocumentHandle &handle){
     RenderProduct self;
+    auto &node = doc.arena.nodes[index];
 
     DNK::Vec2<int> margin (
-        node->getNumberStyle("m") * handle.pixelSize,
-        node->getNumberStyle("s") * handle.pixelSize
+        node.margin * handle.pixelSize,
+        node.spacing * handle.pixelSize
     );
 
     int avLinSpace = wideSpace - margin.x * 2;
     int avLinRSpace = wideSpace - margin.x * 2;
 
-    switch(node->type){
+    switch(node.type){
         case DNK::NodeType::PANEL: {
             std::vector<RenderProduct> products;
-            for(int i = 0; i < node->children.size(); ++i){
+            for(auto child = node.firstChild; child != DNK::Node::NONE; child = doc.arena.nodes[child].nextSibling){
                 products.push_back(
-                    render(node->children[i], node.get(), avLinSpace, handle)
+                    render(doc, child, avLinSpace, handle)
                 );
             }
             int height = margin.y;
@@ -395,18 +260,23 @@ static RenderProduct render(const std::shared_ptr<DNK::Node> &node, DNK::Node *h
                 y += p.canvas->height;
             }
         } break;        
-        case DNK::NodeType::TEXT: {
-            auto tokens = DNK::String::split(node->str, ' ');
+        case DNK::NodeType::TEXT:
+        case DNK::NodeType::TITLE:
+        case DNK::NodeType::SUBTITLE: {
+            auto font = handle.fonts[TextStyle::of(doc, index)];
+            if(font == NULL){
+                break;
+            }
+            auto tokens = DNK::String::split(handle.texts[index], ' ');
             DNK::Vec2<unsigned> cursor(margin.x, margin.y);
-            auto empty = FontRender::getDimensions(handle.currentFont, "A");
-            int lineHeight = DNK::Math::round(node->getNumberStyle("ln") != 0 ? (node->getNumberStyle("ln")+0.3f)*(float)empty.y : (float)empty.y*1.3f);
+            auto empty = FontRender::getDimensions(*font, "A");
+            int lineHeight = DNK::Math::round(node.lineHeight != 0 ? (node.lineHeight+0.3f)*(float)empty.y : (float)empty.y*1.3f);
             auto advX = empty.x;
-            auto advY = empty.y;
             int spacey = margin.y + lineHeight;
             // Get measurement
             for(int i = 0; i < tokens.size(); ++i){
                 auto &t = tokens[i];
-                auto dims = FontRender::getDimensions(handle.currentFont, t);
+                auto dims = DNK::Vec2<unsigned>(FontRender::getWidth(*font, t), empty.y);
                 if(cursor.x + dims.x > avLinRSpace){
                     cursor.y += lineHeight;
                     spacey += lineHeight;
@@ -421,34 +291,115 @@ static RenderProduct render(const std::shared_ptr<DNK::Node> &node, DNK::Node *h
             self.canvas->build(DNK::Colors::White, DNK::ImageFormat::RGBA, handle.minSize.x, spacey);
             for(int i = 0; i < tokens.size(); ++i){
                 auto &t = tokens[i];
-                auto dims = FontRender::getDimensions(handle.currentFont, t);
+                auto dims = DNK::Vec2<unsigned>(FontRender::getWidth(*font, t), empty.y);
                 if(cursor.x + dims.x > avLinRSpace){
                     cursor.y += lineHeight;
                     cursor.x = margin.x;
-                    FontRender::render(handle.currentFont, t, cursor, handle.color, self.canvas.get());
+                    FontRender::renderWord(*font, t, cursor, handle.color, self.canvas.get());
                     cursor.x += advX + dims.x;                   
                 }else{
-                    FontRender::render(handle.currentFont, t, cursor, handle.color, self.canvas.get());
+                    FontRender::renderWord(*font, t, cursor, handle.color, self.canvas.get());
                     cursor.x += advX + dims.x;
                 }
             }          
         } break;
+        case DNK::NodeType::CARDVIDEO: {
+            // nothing plays in an image, a frame the size of the video stands in
+            // for it with the source as caption. w: and h: are rem or % of the line
+            auto length = [&](uint32 key, int whole, int fallback){
+                auto value = doc.getParam(index, key);
+                if(value == NULL){
+                    return fallback;
+                }
+                if(value->type == DNK::ValueType::LENGTH && value->unit == DNK::Unit::PERCENT){
+                    return (int)(whole * value->number / 100.0f);
+                }
+                auto rem = value->rem();
+                return rem > 0.0f ? (int)DNK::Math::round(rem * handle.pixelSize) : fallback;
+            };
+            int width = std::min(length(DNK::AttributeKey::WIDTH, avLinSpace, avLinSpace), avLinSpace);
+            int height = length(DNK::AttributeKey::HEIGHT, avLinSpace, width * 9 / 16);
+            if(width <= 0 || height <= 0){
+                break;
+            }
+            auto font = handle.fonts[TextStyle::CAPTION];
+            auto &caption = handle.texts[index];
+            int captionHeight = font != NULL && caption != "" ? DNK::Math::round(FontRender::getDimensions(*font, "A").y * 1.3f) : 0;
+            int spacey = margin.y * 2 + height + (captionHeight > 0 ? captionHeight + handle.pixelSize / 2 : 0);
+            self.canvas->build(DNK::Colors::White, DNK::ImageFormat::RGBA, handle.minSize.x, spacey);
+            Shape::Rectangle(margin.x, margin.y, width, height, handle.color, *self.canvas);
+            Shape::Circle(margin.x + width / 2, margin.y + height / 2, std::min(width, height) / 6, 10, handle.color, *self.canvas);
+            if(captionHeight > 0){
+                DNK::Vec2<unsigned> at(margin.x, margin.y + height + handle.pixelSize / 2);
+                FontRender::render(*font, caption, at, handle.color, self.canvas.get());
+            }
+        } break;
     }
     return self;
 }
 
-bool DNK::RenderImage(const std::shared_ptr<DNK::Document> &doc, const std::string &filename, unsigned pd){
+bool DNK::RenderImage(const std::shared_ptr<DNK::Document> &doc, const std::string &filename, const DNK::RenderOptions &options){
 
-    int pixelSize = 14 * pd;
+    int pixelSize = 14 * options.pd;
     int fontSize = pixelSize / 2;
 
-    // Load default font
-    FontRender::load("default", "lib/font/arial.ttf", fontSize);
-
-
     DocumentHandle handle;
     handle.init(pixelSize);
-    auto body = render(doc->body, NULL, handle.minSize.x, handle);
+
+    // Every style the document uses is loaded once, here, and everything it will
+    // draw in it rasterized up front, across threads when there's enough of it,
+    // instead of one glyph at a time mid-layout. Only the nodes render() reaches
+    // from the body count, not ones a reparse left behind in the arena, and their
+    // text is kept for it
+    std::vector<unsigned> codepoints[TextStyle::COUNT];
+    std::vector<uint32> stack;
+    if(doc->body != DNK::Node::NONE){
+        stack.push_back(doc->body);
+    }
+    while(!stack.empty()){
+        auto index = stack.back();
+        stack.pop_back();
+        auto &node = doc->arena.nodes[index];
+        if(node.type == DNK::NodeType::PANEL){
+            for(auto child = node.firstChild; child != DNK::Node::NONE; child = doc->arena.nodes[child].nextSibling){
+                stack.push_back(child);
+            }
+            continue;
+        }
+        auto style = TextStyle::of(*doc, index);
+        if(style == TextStyle::COUNT){
+            continue;
+        }
+        auto &text = handle.texts[index];
+        text = TextStyle::text(*doc, index);
+        for(size_t c = 0; c < text.size();){
+            codepoints[style].push_back(DNK::String::decodeUTF8(text, c));
+        }
+    }
+    auto mode = options.sdf ? FontRender::GlyphMode::SDF : FontRender::GlyphMode::COVERAGE;
+    for(unsigned style = 0; style < TextStyle::COUNT; ++style){
+        auto &used = codepoints[style];
+        if(style != TextStyle::BODY && used.size() == 0){
+            continue;
+        }
+        unsigned size = TextStyle::size(fontSize, style);
+        if(FontRender::load(TextStyle::NAMES[style], TextStyle::FONT_FILE, size, options.cacheDir, mode, TextStyle::WEIGHTS[style])){
+            handle.fonts[style] = FontRender::find(TextStyle::NAMES[style]);
+        }else
+        if(style == TextStyle::BODY){
+            fprintf(stderr, "Image::RenderImage: Failed to load the body font\n");
+            return false;
+        }else{
+            // a heading in body text reads better than no heading
+            fprintf(stderr, "Image::RenderImage: Failed to load '%s', drawing it in the body font\n", TextStyle::NAMES[style]);
+            handle.fonts[style] = handle.fonts[TextStyle::BODY];
+        }
+        std::sort(used.begin(), used.end());
+        used.erase(std::unique(used.begin(), used.end()), used.end());
+        FontRender::preload(*handle.fonts[style], used, options.threads);
+    }
+    auto body = render(*doc, doc->body, handle.minSize.x, handle);
+    FontRender::flush();
 
 
 
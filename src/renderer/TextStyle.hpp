@@ -0,0 +1,37 @@
+#ifndef DNK_TEXTSTYLE_HPP
+    #define DNK_TEXTSTYLE_HPP
+
+    #include "../common/Tools.hpp"
+    #include "Font.hpp"
+
+    // How the nodes that draw text draw it. Sizes are in body text sizes, every
+    // style comes out of the one default face. dinky_bake reads the table too,
+    // so every style at the usual sizes is in the binary
+    namespace TextStyle {
+        enum TextStyle : unsigned {
+            BODY,
+            BOLD,       // body text with !bold
+            TITLE,
+            SUBTITLE,
+            CAPTION,    // under media cards
+            COUNT
+        };
+
+        static const char *FONT_FILE = "lib/font/arial.ttf";
+        static const char *NAMES[COUNT] = { "default", "default:bold", "default:title", "default:subtitle", "default:caption" };
+        static const float SCALES[COUNT] = { 1.0f, 1.0f, 2.0f, 1.5f, 0.85f };
+        static const unsigned WEIGHTS[COUNT] = {
+            FontRender::FontWeight::REGULAR,
+            FontRender::FontWeight::BOLD,
+            FontRender::FontWeight::BOLD,
+            FontRender::FontWeight::BOLD,
+            FontRender::FontWeight::REGULAR
+        };
+
+        // pixel size of `style` when body text is `fontSize`
+        inline unsigned size(int fontSize, unsigned style){
+            return std::max(1, (int)DNK::Math::round(fontSize * SCALES[style]));
+        }
+    }
+
+#endif